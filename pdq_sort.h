@@ -0,0 +1,417 @@
+#pragma once
+
+#include "/root/env/snippets/cpp/cpp_test_common.h"
+#include <iterator>
+#include <type_traits>
+
+//pdq sort
+//https://github.com/orlp/pdqsort
+//随机访问迭代器 + 比较函数的通用版本，下标和长度都用迭代器的difference_type(64位)
+//所有移动都用move和iter_swap，只能move的类型也可以排序
+//和intro sort的区别:
+//1 分区时先按块(PDQ_BLOCK_SIZE)扫描，只把需要交换的位置记在offsets里，扫描循环里没有分支，再批量交换
+//  随机数据下比较结果无法预测，快排的主要开销是分支预测失败，这样就避开了
+//  比较本身有分支或者开销大时(比如字符串)，这么做反而更慢，所以只对算术类型+less/greater开启
+//2 分区时一次交换都没做(already partitioned)，说明数据可能本来就有序，用有移动次数上限的插入排序试一下
+//3 分区严重不平衡时，打乱几个位置再继续，破坏针对三点中值构造的输入
+//4 pivot和左边界前一个数相等时，说明区间里大量和pivot相等的数，把等于pivot的数都分到左边，然后跳过
+#define PDQ_INSERTION_SORT_THRESHOLD 24
+#define PDQ_NINTHER_THRESHOLD 128
+#define PDQ_PARTIAL_INSERTION_SORT_LIMIT 8
+#define PDQ_BLOCK_SIZE 64
+
+template <typename Iter, typename Compare>
+constexpr bool pdq_branchless = is_arithmetic_v<typename iterator_traits<Iter>::value_type> && (
+    is_same_v<Compare, std::less<typename iterator_traits<Iter>::value_type>> ||
+    is_same_v<Compare, std::greater<typename iterator_traits<Iter>::value_type>> ||
+    is_same_v<Compare, std::less<>> || is_same_v<Compare, std::greater<>>);
+
+template <typename Iter, typename Compare>
+void pdq_insertion_sort(Iter begin, Iter end, Compare comp) {
+    using T = typename iterator_traits<Iter>::value_type;
+    if (begin == end) {
+        return;
+    }
+    for (Iter cur = begin + 1;cur != end;cur++) {
+        Iter sift = cur;
+        Iter sift_1 = cur - 1;
+        if (comp(*sift, *sift_1)) {
+            T tmp = move(*sift);
+            do {
+                *sift-- = move(*sift_1);
+            } while(sift != begin && comp(tmp, *--sift_1));
+            *sift = move(tmp);
+        }
+    }
+}
+
+//要求begin - 1处的数不大于区间里所有数，内层循环不判断越界
+template <typename Iter, typename Compare>
+void pdq_unguarded_insertion_sort(Iter begin, Iter end, Compare comp) {
+    using T = typename iterator_traits<Iter>::value_type;
+    if (begin == end) {
+        return;
+    }
+    for (Iter cur = begin + 1;cur != end;cur++) {
+        Iter sift = cur;
+        Iter sift_1 = cur - 1;
+        if (comp(*sift, *sift_1)) {
+            T tmp = move(*sift);
+            do {
+                *sift-- = move(*sift_1);
+            } while(comp(tmp, *--sift_1));
+            *sift = move(tmp);
+        }
+    }
+}
+
+//移动次数超过PDQ_PARTIAL_INSERTION_SORT_LIMIT就放弃，返回false
+template <typename Iter, typename Compare>
+bool pdq_partial_insertion_sort(Iter begin, Iter end, Compare comp) {
+    using T = typename iterator_traits<Iter>::value_type;
+    if (begin == end) {
+        return true;
+    }
+    typename iterator_traits<Iter>::difference_type limit = 0;
+    for (Iter cur = begin + 1;cur != end;cur++) {
+        Iter sift = cur;
+        Iter sift_1 = cur - 1;
+        if (comp(*sift, *sift_1)) {
+            T tmp = move(*sift);
+            do {
+                *sift-- = move(*sift_1);
+            } while(sift != begin && comp(tmp, *--sift_1));
+            *sift = move(tmp);
+            limit += cur - sift;
+        }
+        if (limit > PDQ_PARTIAL_INSERTION_SORT_LIMIT) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename Iter, typename Compare>
+void pdq_sort2(Iter a, Iter b, Compare comp) {
+    if (comp(*b, *a)) iter_swap(a, b);
+}
+
+template <typename Iter, typename Compare>
+void pdq_sort3(Iter a, Iter b, Iter c, Compare comp) {
+    pdq_sort2(a, b, comp);
+    pdq_sort2(b, c, comp);
+    pdq_sort2(a, b, comp);
+}
+
+//左边offsets_l[i]和右边offsets_r[i]一一交换，两边个数相等时，可以用一次循环移位代替逐对交换
+template <typename Iter>
+void pdq_swap_offsets(Iter first, Iter last, unsigned char *offsets_l, unsigned char *offsets_r,
+    int64_t num, bool use_swaps) {
+    using T = typename iterator_traits<Iter>::value_type;
+    if (use_swaps) {
+        for (int64_t i = 0;i < num;i++) {
+            iter_swap(first + offsets_l[i], last - offsets_r[i]);
+        }
+    }else if (num > 0) {
+        Iter l = first + offsets_l[0];
+        Iter r = last - offsets_r[0];
+        T tmp(move(*l));
+        *l = move(*r);
+        for (int64_t i = 1;i < num;i++) {
+            l = first + offsets_l[i];
+            *r = move(*l);
+            r = last - offsets_r[i];
+            *l = move(*r);
+        }
+        *r = move(tmp);
+    }
+}
+
+//pivot在begin上，分区后[begin, pivot_pos) < pivot，(pivot_pos, end) >= pivot
+//返回pivot_pos，以及是否一次交换都没做
+template <typename Iter, typename Compare>
+pair<Iter, bool> pdq_partition_right_branchless(Iter begin, Iter end, Compare comp) {
+    using T = typename iterator_traits<Iter>::value_type;
+    T pivot(move(*begin));
+    Iter first = begin;
+    Iter last = end;
+
+    //begin后第一个>=pivot的数，三点中值保证一定能找到
+    while(comp(*++first, pivot));
+    //first前面没有数的话，last可能越过first，要判断边界
+    if (first - 1 == begin) {
+        while(first < last && !comp(*--last, pivot));
+    }else {
+        while(!comp(*--last, pivot));
+    }
+
+    bool already_partitioned = first >= last;
+    if (!already_partitioned) {
+        iter_swap(first, last);
+        first++;
+
+        alignas(64) unsigned char offsets_l[PDQ_BLOCK_SIZE];
+        alignas(64) unsigned char offsets_r[PDQ_BLOCK_SIZE];
+        Iter offsets_l_base = first;
+        Iter offsets_r_base = last;
+        int64_t num_l = 0, num_r = 0, start_l = 0, start_r = 0;
+        while(first < last) {
+            //剩余不够两个整块时，按还缺offsets的一边来分
+            int64_t num_unknown = last - first;
+            int64_t left_split = num_l == 0 ? (num_r == 0 ? num_unknown / 2 : num_unknown) : 0;
+            int64_t right_split = num_r == 0 ? (num_unknown - left_split) : 0;
+
+            //无分支: 每个位置都写进offsets，只有比较结果为true时计数才加1
+            if (left_split >= PDQ_BLOCK_SIZE) {
+                for (int i = 0;i < PDQ_BLOCK_SIZE;) {
+                    offsets_l[num_l] = i++; num_l += !comp(*first, pivot); first++;
+                    offsets_l[num_l] = i++; num_l += !comp(*first, pivot); first++;
+                    offsets_l[num_l] = i++; num_l += !comp(*first, pivot); first++;
+                    offsets_l[num_l] = i++; num_l += !comp(*first, pivot); first++;
+                }
+            }else {
+                for (int i = 0;i < left_split;) {
+                    offsets_l[num_l] = i++; num_l += !comp(*first, pivot); first++;
+                }
+            }
+            if (right_split >= PDQ_BLOCK_SIZE) {
+                for (int i = 0;i < PDQ_BLOCK_SIZE;) {
+                    offsets_r[num_r] = ++i; num_r += comp(*--last, pivot);
+                    offsets_r[num_r] = ++i; num_r += comp(*--last, pivot);
+                    offsets_r[num_r] = ++i; num_r += comp(*--last, pivot);
+                    offsets_r[num_r] = ++i; num_r += comp(*--last, pivot);
+                }
+            }else {
+                for (int i = 0;i < right_split;) {
+                    offsets_r[num_r] = ++i; num_r += comp(*--last, pivot);
+                }
+            }
+
+            int64_t num = min(num_l, num_r);
+            pdq_swap_offsets(offsets_l_base, offsets_r_base, offsets_l + start_l, offsets_r + start_r,
+                num, num_l == num_r);
+            num_l -= num;
+            num_r -= num;
+            start_l += num;
+            start_r += num;
+            if (num_l == 0) {
+                start_l = 0;
+                offsets_l_base = first;
+            }
+            if (num_r == 0) {
+                start_r = 0;
+                offsets_r_base = last;
+            }
+        }
+
+        //只剩一边有没交换完的offsets，从后往前和另一边的边界交换
+        if (num_l) {
+            while(num_l--) {
+                iter_swap(offsets_l_base + offsets_l[start_l + num_l], --last);
+            }
+            first = last;
+        }
+        if (num_r) {
+            while(num_r--) {
+                iter_swap(offsets_r_base - offsets_r[start_r + num_r], first);
+                first++;
+            }
+            last = first;
+        }
+    }
+
+    Iter pivot_pos = first - 1;
+    *begin = move(*pivot_pos);
+    *pivot_pos = move(pivot);
+    return {pivot_pos, already_partitioned};
+}
+
+//和pdq_partition_right_branchless的结果一样，比较时有分支，比较开销大的类型用这个
+template <typename Iter, typename Compare>
+pair<Iter, bool> pdq_partition_right(Iter begin, Iter end, Compare comp) {
+    using T = typename iterator_traits<Iter>::value_type;
+    T pivot(move(*begin));
+    Iter first = begin;
+    Iter last = end;
+
+    while(comp(*++first, pivot));
+    if (first - 1 == begin) {
+        while(first < last && !comp(*--last, pivot));
+    }else {
+        while(!comp(*--last, pivot));
+    }
+
+    bool already_partitioned = first >= last;
+    while(first < last) {
+        iter_swap(first, last);
+        while(comp(*++first, pivot));
+        while(!comp(*--last, pivot));
+    }
+
+    Iter pivot_pos = first - 1;
+    *begin = move(*pivot_pos);
+    *pivot_pos = move(pivot);
+    return {pivot_pos, already_partitioned};
+}
+
+//和pdq_partition_right相反，等于pivot的数都分到左边，[begin, pivot_pos] <= pivot
+template <typename Iter, typename Compare>
+Iter pdq_partition_left(Iter begin, Iter end, Compare comp) {
+    using T = typename iterator_traits<Iter>::value_type;
+    T pivot(move(*begin));
+    Iter first = begin;
+    Iter last = end;
+
+    while(comp(pivot, *--last));
+    if (last + 1 == end) {
+        while(first < last && !comp(pivot, *++first));
+    }else {
+        while(!comp(pivot, *++first));
+    }
+    while(first < last) {
+        iter_swap(first, last);
+        while(comp(pivot, *--last));
+        while(!comp(pivot, *++first));
+    }
+
+    Iter pivot_pos = last;
+    *begin = move(*pivot_pos);
+    *pivot_pos = move(pivot);
+    return pivot_pos;
+}
+
+inline int pdq_log2(int64_t n) {
+    int log = 0;
+    while(n >>= 1) {
+        log++;
+    }
+    return log;
+}
+
+template <bool Branchless, typename Iter, typename Compare>
+void pdq_sort_loop(Iter begin, Iter end, Compare comp, int bad_allowed, bool leftmost = true) {
+    using diff_t = typename iterator_traits<Iter>::difference_type;
+    while(true) {
+        diff_t size = end - begin;
+        if (size < PDQ_INSERTION_SORT_THRESHOLD) {
+            if (leftmost) {
+                pdq_insertion_sort(begin, end, comp);
+            }else {
+                pdq_unguarded_insertion_sort(begin, end, comp);
+            }
+            return;
+        }
+
+        diff_t s2 = size / 2;
+        if (size > PDQ_NINTHER_THRESHOLD) {
+            pdq_sort3(begin, begin + s2, end - 1, comp);
+            pdq_sort3(begin + 1, begin + (s2 - 1), end - 2, comp);
+            pdq_sort3(begin + 2, begin + (s2 + 1), end - 3, comp);
+            pdq_sort3(begin + (s2 - 1), begin + s2, begin + (s2 + 1), comp);
+            iter_swap(begin, begin + s2);
+        }else {
+            pdq_sort3(begin + s2, begin, end - 1, comp);
+        }
+
+        //左边界前一个数是上一轮的pivot，不小于当前pivot，说明当前pivot就是区间最小值
+        if (!leftmost && !comp(*(begin - 1), *begin)) {
+            begin = pdq_partition_left(begin, end, comp) + 1;
+            continue;
+        }
+
+        auto [pivot_pos, already_partitioned] = Branchless ?
+            pdq_partition_right_branchless(begin, end, comp) : pdq_partition_right(begin, end, comp);
+        diff_t l_size = pivot_pos - begin;
+        diff_t r_size = end - (pivot_pos + 1);
+        bool highly_unbalanced = l_size < size / 8 || r_size < size / 8;
+
+        if (highly_unbalanced) {
+            if (--bad_allowed == 0) {
+                make_heap(begin, end, comp);
+                sort_heap(begin, end, comp);
+                return;
+            }
+            if (l_size >= PDQ_INSERTION_SORT_THRESHOLD) {
+                iter_swap(begin, begin + l_size / 4);
+                iter_swap(pivot_pos - 1, pivot_pos - l_size / 4);
+                if (l_size > PDQ_NINTHER_THRESHOLD) {
+                    iter_swap(begin + 1, begin + (l_size / 4 + 1));
+                    iter_swap(begin + 2, begin + (l_size / 4 + 2));
+                    iter_swap(pivot_pos - 2, pivot_pos - (l_size / 4 + 1));
+                    iter_swap(pivot_pos - 3, pivot_pos - (l_size / 4 + 2));
+                }
+            }
+            if (r_size >= PDQ_INSERTION_SORT_THRESHOLD) {
+                iter_swap(pivot_pos + 1, pivot_pos + (1 + r_size / 4));
+                iter_swap(end - 1, end - r_size / 4);
+                if (r_size > PDQ_NINTHER_THRESHOLD) {
+                    iter_swap(pivot_pos + 2, pivot_pos + (2 + r_size / 4));
+                    iter_swap(pivot_pos + 3, pivot_pos + (3 + r_size / 4));
+                    iter_swap(end - 2, end - (1 + r_size / 4));
+                    iter_swap(end - 3, end - (2 + r_size / 4));
+                }
+            }
+        }else if (already_partitioned && pdq_partial_insertion_sort(begin, pivot_pos, comp)
+            && pdq_partial_insertion_sort(pivot_pos + 1, end, comp)) {
+            return;
+        }
+
+        //只递归左边，右边继续循环
+        pdq_sort_loop<Branchless>(begin, pivot_pos, comp, bad_allowed, leftmost);
+        begin = pivot_pos + 1;
+        leftmost = false;
+    }
+}
+
+template <typename Iter, typename Compare = std::less<typename iterator_traits<Iter>::value_type>>
+void pdq_sort(Iter begin, Iter end, Compare comp = Compare()) {
+    if (end - begin < 2) {
+        return;
+    }
+    pdq_sort_loop<pdq_branchless<Iter, Compare>>(begin, end, comp, pdq_log2(end - begin));
+}
+
+//按key排序，keyFunc对每个元素只调用一次，key和原下标缓存在一起排序，key相等时按原下标，所以是稳定的
+//排好后按下标沿着置换环把元素move到位，每个元素只移动一次
+template <typename Iter, typename KeyFunc, typename Compare = std::less<>>
+void pdq_sort_by_key(Iter begin, Iter end, KeyFunc keyFunc, Compare comp = Compare()) {
+    using T = typename iterator_traits<Iter>::value_type;
+    using KeyT = decay_t<decltype(keyFunc(*begin))>;
+    size_t n = end - begin;
+    if (n < 2) {
+        return;
+    }
+    vector<pair<KeyT, size_t>> keys;
+    keys.reserve(n);
+    for (size_t i = 0;i < n;i++) {
+        keys.emplace_back(keyFunc(begin[i]), i);
+    }
+    pdq_sort(keys.begin(), keys.end(), [&comp](const pair<KeyT, size_t> &a, const pair<KeyT, size_t> &b) {
+        if (comp(a.first, b.first)) return true;
+        if (comp(b.first, a.first)) return false;
+        return a.second < b.second;
+    });
+
+    //from[i]: 排序后i位置上的元素原来在哪，处理过的位置标成自己
+    vector<size_t> from(n);
+    for (size_t i = 0;i < n;i++) {
+        from[i] = keys[i].second;
+    }
+    vector<pair<KeyT, size_t>>().swap(keys);
+    for (size_t i = 0;i < n;i++) {
+        if (from[i] == i) {
+            continue;
+        }
+        T tmp = move(begin[i]);
+        size_t cur = i;
+        while(from[cur] != i) {
+            size_t next = from[cur];
+            begin[cur] = move(begin[next]);
+            from[cur] = cur;
+            cur = next;
+        }
+        begin[cur] = move(tmp);
+        from[cur] = cur;
+    }
+}
+//pdq sort end
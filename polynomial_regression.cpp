@@ -9,88 +9,197 @@ enum curveFitERROR{
     NPOINTS_INCORRECT = -3
 };
 
-void cpyArray(double *src, double*dest, int n){
-    for (int i = 0; i < n*n; i++){
-        dest[i] = src[i];
+//Raise x to power
+double curveFitPower(double base, int exponent){
+    if (exponent == 0){
+        return 1;
+    } else {
+        double val = base;
+        for (int i = 1; i < exponent; i++){
+            val = val * base;
+        }
+        return val;
     }
 }
 
-void subCol(double *mat, double* sub, uint8_t coln, uint8_t n){
-    if (coln >= n) return;
-    for (int i = 0; i < n; i++){
-        mat[(i*n)+coln] = sub[i];
+//Bernoulli numbers B+_0..B+_{2*MAX_ORDER}, B+_m = 1 - sum(C(m,k)*B+_k/(m-k+1)), k < m
+const long double *bernoulliTable(){
+    static const array<long double, MAX_ORDER*2+1> table = []{
+        array<long double, MAX_ORDER*2+1> B{};
+        for (int m = 0; m < int(B.size()); m++){
+            long double sum = 0, binom = 1; //binom = C(m,k)
+            for (int k = 0; k < m; k++){
+                sum += binom * B[k] / (m - k + 1);
+                binom = binom * (m - k) / (k + 1);
+            }
+            B[m] = 1 - sum;
+        }
+        return B;
+    }();
+    return table.data();
+}
+
+//Faulhaber's formula, 1^p + 2^p + ... + N^p without touching N values
+long double powerSum(long double N, int p){
+    const long double *B = bernoulliTable();
+    long double sum = 0, binom = 1; //binom = C(p+1,r)
+    for (int r = 0; r <= p; r++){
+        sum += binom * B[r] * powl(N, p + 1 - r);
+        binom = binom * (p + 1 - r) / (r + 1);
     }
+    return sum / (p + 1);
 }
 
-/*Determinant algorithm taken from https://codeforwin.org/2015/08/c-program-to-find-determinant-of-matrix.html */
-int trianglize(double **m, int n)
-{
-    int sign = 1;
-    for (int i = 0; i < n; i++) {
-        int max = 0;
-        for (int row = i; row < n; row++)
-            if (fabs(m[row][i]) > fabs(m[max][i]))
-                max = row;
-        if (max) {
-            sign = -sign;
-            double *tmp = m[i];
-            m[i] = m[max], m[max] = tmp;
-        }
-        if (!m[i][i]) return 0;
-        for (int row = i + 1; row < n; row++) {
+//Solve sum(S[i+j]*a[j]) = T[i], a[j] is the coefficient of x^j. The normal matrix is symmetric
+//positive definite, so Gaussian elimination needs no pivoting. m is the caller's nCoeffs*nCoeffs
+//scratch buffer, returns false if the system is singular
+bool solveNormalEquations(const double *S, const double *T, int nCoeffs, double *m, double *a){
+    for (int i = 0; i < nCoeffs; i++){
+        a[i] = T[i];
+        for (int j = 0; j < nCoeffs; j++){
+            m[i*nCoeffs+j] = S[i+j];
+        }
+    }
+    for (int i = 0; i < nCoeffs; i++){
+        if (m[i*nCoeffs+i] <= 0) return false;
+        for (int row = i + 1; row < nCoeffs; row++){
+            double r = m[row*nCoeffs+i] / m[i*nCoeffs+i];
+            for (int col = i; col < nCoeffs; col++) m[row*nCoeffs+col] -= m[i*nCoeffs+col] * r;
+            a[row] -= a[i] * r;
+        }
+    }
+    for (int i = nCoeffs - 1; i >= 0; i--){
+        for (int j = i + 1; j < nCoeffs; j++) a[i] -= m[i*nCoeffs+j] * a[j];
+        a[i] /= m[i*nCoeffs+i];
+    }
+    return true;
+}
+
+//Same elimination with N known at compile time: the matrix is a fixed-size local and every
+//loop is fully unrolled (20 == MAX_ORDER, pragma arguments aren't macro expanded)
+template <int N>
+inline bool solveNormalEquationsFixed(const array<double, N*2-1> &S, const array<double, N> &T, array<double, N> &a){
+    array<array<double, N>, N> m;
+    #pragma GCC unroll 20
+    for (int i = 0; i < N; i++){
+        a[i] = T[i];
+        #pragma GCC unroll 20
+        for (int j = 0; j < N; j++){
+            m[i][j] = S[i+j];
+        }
+    }
+    #pragma GCC unroll 20
+    for (int i = 0; i < N; i++){
+        if (m[i][i] <= 0) return false;
+        #pragma GCC unroll 20
+        for (int row = i + 1; row < N; row++){
             double r = m[row][i] / m[i][i];
-            if (!r) continue;
-            for (int col = i; col < n; col ++)
-                m[row][col] -= m[i][col] * r;
+            #pragma GCC unroll 20
+            for (int col = i; col < N; col++) m[row][col] -= m[i][col] * r;
+            a[row] -= a[i] * r;
         }
     }
-    return sign;
+    #pragma GCC unroll 20
+    for (int i = N - 1; i >= 0; i--){
+        #pragma GCC unroll 20
+        for (int j = i + 1; j < N; j++) a[i] -= m[i][j] * a[j];
+        a[i] /= m[i][i];
+    }
+    return true;
 }
 
-double det(double *in, int n)
-{
-    double *m[n];
-    m[0] = in;
+//x is implicitly 0..n-1, fit in u = x - (n-1)/2 so the sums stay small and symmetric,
+//S[j] over u has a closed form (odd j are 0), only T[j] needs one pass over y
+int fitCurve (int order, const vector<double> &py, vector<double> &coeffs) {
+    int nCoeffs = order + 1;
+    int64_t n = py.size();
+    if (order < 1 || nCoeffs > MAX_ORDER) return ORDER_INCORRECT;
+    if (int(coeffs.size()) < nCoeffs) return ORDER_AND_NCOEFFS_DO_NOT_MATCH;
+    if (n < nCoeffs) return NPOINTS_INCORRECT;
+
+    double T[MAX_ORDER] = {0}; //Values to generate RHS of linear equation
+    double S[MAX_ORDER*2+1] = {0}; //Values for LHS and RHS of linear equation
+    double c = (n - 1) / 2.0;
+
+    //half = n/2 rounded down
+    //n odd:  u = -half..half,          S[j] = 2*(1^j+...+half^j)
+    //n even: u = +-1/2..+-(2half-1)/2, S[j] = 2^(1-j)*(1^j+3^j+...+(2half-1)^j)
+    S[0] = n;
+    long double half = n / 2;
+    for (int j = 2; j < (nCoeffs*2)-1; j += 2){
+        if (n % 2){
+            S[j] = 2 * powerSum(half, j);
+        } else {
+            S[j] = ldexpl(powerSum(2 * half, j) - ldexpl(powerSum(half, j), j), 1 - j);
+        }
+    }
+
+    for (int64_t i = 0; i < n; i++) {
+        double u = i - c;
+        double p = py[i]; //y * u^j
+        for (int j = 0; j < nCoeffs; j++){
+            T[j] += p;
+            p *= u;
+        }
+    }
+
+    double scratch[MAX_ORDER*MAX_ORDER], b[MAX_ORDER]; //b[j] is the coefficient of u^j
+    if (!solveNormalEquations(S, T, nCoeffs, scratch, b)) return NPOINTS_INCORRECT;
 
-    for (int i = 1; i < n; i++)
-        m[i] = m[i - 1] + n;
-    int sign = trianglize(m, n);
-    if (!sign)
-        return 0;
-    double p = 1;
-    for (int i = 0; i < n; i++)
-        p *= m[i][i];
-    return p * sign;
+    //Shift back to x: a[k] = sum(b[j] * C(j,k) * (-c)^(j-k)), j >= k
+    for (int k = 0; k < nCoeffs; k++){
+        double a = 0, binom = 1, shift = 1; //C(j,k), (-c)^(j-k)
+        for (int j = k; j < nCoeffs; j++){
+            a += b[j] * binom * shift;
+            binom = binom * (j + 1) / (j + 1 - k);
+            shift *= -c;
+        }
+        coeffs[nCoeffs-k-1] = a;
+    }
+    return 0;
 }
-/*End of Determinant algorithm*/
 
-//Raise x to power
-double curveFitPower(double base, int exponent){
-    if (exponent == 0){
-        return 1;
-    } else {
-        double val = base;
-        for (int i = 1; i < exponent; i++){
-            val = val * base;
+//Order known at compile time: fixed-size sums and the fixed-size solver, every loop has a
+//constant trip count
+template <int Order>
+int fitCurve (const vector<double> &px, const vector<double> &py, vector<double> &coeffs) {
+    constexpr int nCoeffs = Order + 1;
+    static_assert(Order >= 1 && nCoeffs <= MAX_ORDER, "order out of range");
+    if (int(coeffs.size()) < nCoeffs) return ORDER_AND_NCOEFFS_DO_NOT_MATCH;
+    int64_t n = px.size();
+    if (n < nCoeffs || int64_t(py.size()) != n) return NPOINTS_INCORRECT;
+
+    array<double, nCoeffs*2-1> S{};
+    array<double, nCoeffs> T{};
+    for (int64_t i = 0; i < n; i++) {
+        double x = px[i], y = py[i];
+        double p = 1; //x^j
+        for (int j = 0; j < nCoeffs*2-1; j++){
+            S[j] += p;
+            if (j < nCoeffs) T[j] += y * p;
+            p *= x;
         }
-        return val;
     }
+
+    array<double, nCoeffs> a;
+    if (!solveNormalEquationsFixed<nCoeffs>(S, T, a)) return NPOINTS_INCORRECT;
+    for (int i = 0; i < nCoeffs; i++){
+        coeffs[nCoeffs-i-1] = a[i];
+    }
+    return 0;
 }
 
-int fitCurve (int order, vector<double> py, vector<double> &coeffs) {
+int fitCurveGeneric (int order, const vector<double> &px, const vector<double> &py, vector<double> &coeffs) {
     int i, j;
     double T[MAX_ORDER] = {0}; //Values to generate RHS of linear equation
     double S[MAX_ORDER*2+1] = {0}; //Values for LHS and RHS of linear equation
-    double denom; //denominator for Cramer's rule, determinant of LHS linear equation
     double x, y;
     int nCoeffs = order + 1;
+    if (order < 1 || nCoeffs > MAX_ORDER) return ORDER_INCORRECT;
+    if (int(coeffs.size()) < nCoeffs) return ORDER_AND_NCOEFFS_DO_NOT_MATCH;
+    if (int64_t(px.size()) < nCoeffs || py.size() != px.size()) return NPOINTS_INCORRECT;
 
-    vector<double> px(py.size()); //Generate X values, from 0 to n
-    for (i=0; i< int(py.size()); i++){
-        px[i] = i;
-    }
-
-    for (i=0; i < int(py.size()); i++) {//Generate matrix elements
+    for (i=0; i < int(px.size()); i++) {//Generate matrix elements
         x = px[i];
         y = py[i];
         for (j = 0; j < (nCoeffs*2)-1; j++){
@@ -101,66 +210,451 @@ int fitCurve (int order, vector<double> py, vector<double> &coeffs) {
         }
     }
 
-    double masterMat[nCoeffs*nCoeffs]; //Master matrix LHS of linear equation
-    for (i = 0; i < nCoeffs ;i++){//index by matrix row each time
-        for (j = 0; j < nCoeffs; j++){//index within each row
-            masterMat[i*nCoeffs+j] = S[i+j];
+    double m[MAX_ORDER*MAX_ORDER], a[MAX_ORDER];
+    if (!solveNormalEquations(S, T, nCoeffs, m, a)) return NPOINTS_INCORRECT;
+    for (i = 0; i < nCoeffs; i++){
+        coeffs[nCoeffs-i-1] = a[i];
+    }
+    return 0;
+} 
+
+//Orders 1..3 cover most fits, route them to fitCurve<Order> and its unrolled fixed-size solver
+int fitCurve (int order, const vector<double> &px, const vector<double> &py, vector<double> &coeffs) {
+    int nCoeffs = order + 1;
+    if (order < 1 || nCoeffs > MAX_ORDER) return ORDER_INCORRECT;
+    if (int(coeffs.size()) < nCoeffs) return ORDER_AND_NCOEFFS_DO_NOT_MATCH;
+    if (int64_t(px.size()) < nCoeffs || py.size() != px.size()) return NPOINTS_INCORRECT;
+    switch (order) {
+    case 1: return fitCurve<1>(px, py, coeffs);
+    case 2: return fitCurve<2>(px, py, coeffs);
+    case 3: return fitCurve<3>(px, py, coeffs);
+    default: return fitCurveGeneric(order, px, py, coeffs);
+    }
+}
+
+//S[j] = sum(w*x^j), T[j] = sum(w*y*x^j), w == nullptr means every weight is 1
+void accumulateWeighted(int nCoeffs, const vector<double> &px, const vector<double> &py, const double *w, double *S, double *T){
+    for (int j = 0; j < (nCoeffs*2)-1; j++) S[j] = 0;
+    for (int j = 0; j < nCoeffs; j++) T[j] = 0;
+    for (int64_t i = 0; i < int64_t(px.size()); i++){
+        double p = w ? w[i] : 1; //w*x^j
+        if (p == 0) continue;
+        double y = py[i];
+        for (int j = 0; j < (nCoeffs*2)-1; j++){
+            S[j] += p;
+            if (j < nCoeffs) T[j] += y * p;
+            p *= px[i];
         }
     }
+}
 
-    double mat[nCoeffs*nCoeffs]; //Temp matrix as det() method alters the matrix given
-    cpyArray(masterMat, mat, nCoeffs);
-    denom = det(mat, nCoeffs);
-    cpyArray(masterMat, mat, nCoeffs);
+int fitCurveWeighted (int order, const vector<double> &px, const vector<double> &py, const vector<double> &pw, vector<double> &coeffs) {
+    int nCoeffs = order + 1;
+    if (order < 1 || nCoeffs > MAX_ORDER) return ORDER_INCORRECT;
+    if (int(coeffs.size()) < nCoeffs) return ORDER_AND_NCOEFFS_DO_NOT_MATCH;
+    if (int64_t(px.size()) < nCoeffs || py.size() != px.size() || pw.size() != px.size()) return NPOINTS_INCORRECT;
 
-    //Generate cramers rule mats
-    for (i = 0; i < nCoeffs; i++){ //Temporary matrix to substitute RHS of linear equation as per Cramer's rule
-        subCol(mat, T, i, nCoeffs);
-        coeffs[nCoeffs-i-1] = det(mat, nCoeffs)/denom; //Coefficients are det(M_i)/det(Master)
-        cpyArray(masterMat, mat, nCoeffs);
+    double S[MAX_ORDER*2+1], T[MAX_ORDER], m[MAX_ORDER*MAX_ORDER], a[MAX_ORDER];
+    accumulateWeighted(nCoeffs, px, py, pw.data(), S, T);
+    if (!solveNormalEquations(S, T, nCoeffs, m, a)) return NPOINTS_INCORRECT;
+    for (int i = 0; i < nCoeffs; i++){
+        coeffs[nCoeffs-i-1] = a[i];
     }
     return 0;
 }
 
-int fitCurve (int order, vector<double> px, vector<double> py, vector<double> &coeffs) {
-    int i, j;
-    double T[MAX_ORDER] = {0}; //Values to generate RHS of linear equation
-    double S[MAX_ORDER*2+1] = {0}; //Values for LHS and RHS of linear equation
-    double denom; //denominator for Cramer's rule, determinant of LHS linear equation
-    double x, y;
+enum curveFitLoss{
+    LOSS_HUBER,
+    LOSS_TUKEY
+};
+
+//Iteratively reweighted least squares. Each pass evaluates the residuals, takes the scale from
+//their MAD and refits with w = baseWeight * psi(r/s)/(r/s). All buffers are sized once up front,
+//the passes only overwrite them. tuning = 0 picks the usual 95% efficiency constants
+int fitCurveRobust (int order, const vector<double> &px, const vector<double> &py, vector<double> &coeffs,
+    curveFitLoss loss, int maxIter = 20, double tuning = 0, const vector<double> *pw = nullptr) {
     int nCoeffs = order + 1;
+    int64_t n = px.size();
+    if (order < 1 || nCoeffs > MAX_ORDER) return ORDER_INCORRECT;
+    if (int(coeffs.size()) < nCoeffs) return ORDER_AND_NCOEFFS_DO_NOT_MATCH;
+    if (n < nCoeffs || int64_t(py.size()) != n || (pw && int64_t(pw->size()) != n)) return NPOINTS_INCORRECT;
+    if (tuning <= 0) tuning = loss == LOSS_HUBER ? 1.345 : 4.685;
 
-    for (i=0; i < int(px.size()); i++) {//Generate matrix elements
-        x = px[i];
-        y = py[i];
-        for (j = 0; j < (nCoeffs*2)-1; j++){
-            S[j] += curveFitPower(x, j); // x^j iterated , S10 S20 S30 etc, x^0, x^1...
+    double S[MAX_ORDER*2+1], T[MAX_ORDER], m[MAX_ORDER*MAX_ORDER], a[MAX_ORDER];
+    vector<double> w(n), absResidual(n);
+    accumulateWeighted(nCoeffs, px, py, pw ? pw->data() : nullptr, S, T);
+    if (!solveNormalEquations(S, T, nCoeffs, m, a)) return NPOINTS_INCORRECT;
+
+    for (int iter = 0; iter < maxIter; iter++){
+        for (int64_t i = 0; i < n; i++){
+            double f = a[order];
+            for (int j = order - 1; j >= 0; j--) f = f * px[i] + a[j];
+            absResidual[i] = fabs(py[i] - f);
         }
-        for (j = 0; j < nCoeffs; j++){
-            T[j] += y * curveFitPower(x, j); //y * x^j iterated, S01 S11 S21 etc, x^0*y, x^1*y, x^2*y...
+        //w doubles as scratch for the median so the residuals stay in order
+        copy(absResidual.begin(), absResidual.end(), w.begin());
+        nth_element(w.begin(), w.begin() + n / 2, w.end());
+        double scale = w[n / 2] / 0.6745;
+        if (scale <= 0) break; //more than half the points already on the curve
+
+        for (int64_t i = 0; i < n; i++){
+            double u = absResidual[i] / (scale * tuning);
+            if (loss == LOSS_HUBER){
+                w[i] = u <= 1 ? 1 : 1 / u;
+            } else {
+                w[i] = u < 1 ? (1 - u * u) * (1 - u * u) : 0;
+            }
+            if (pw) w[i] *= (*pw)[i];
         }
+        accumulateWeighted(nCoeffs, px, py, w.data(), S, T);
+        double prev[MAX_ORDER];
+        copy(a, a + nCoeffs, prev);
+        if (!solveNormalEquations(S, T, nCoeffs, m, a)) return NPOINTS_INCORRECT;
+
+        bool converged = true;
+        for (int j = 0; j < nCoeffs; j++){
+            if (fabs(a[j] - prev[j]) > 1e-10 * max(1.0, fabs(a[j]))) converged = false;
+        }
+        if (converged) break;
+    }
+    for (int i = 0; i < nCoeffs; i++){
+        coeffs[nCoeffs-i-1] = a[i];
     }
+    return 0;
+}
+
+//Neumaier compensated sum, the lost low bits are kept in c
+struct KahanSum {
+    double sum = 0, c = 0;
+    void add(double v){
+        double t = sum + v;
+        if (fabs(sum) >= fabs(v)) c += (sum - t) + v;
+        else c += (v - t) + sum;
+        sum = t;
+    }
+    double value() const {
+        return sum + c;
+    }
+};
+
+struct PartialSums {
+    KahanSum S[MAX_ORDER*2+1];
+    KahanSum T[MAX_ORDER];
+};
 
-    double masterMat[nCoeffs*nCoeffs]; //Master matrix LHS of linear equation
-    for (i = 0; i < nCoeffs ;i++){//index by matrix row each time
-        for (j = 0; j < nCoeffs; j++){//index within each row
-            masterMat[i*nCoeffs+j] = S[i+j];
+void accumulateChunk(const double *px, const double *py, int64_t begin, int64_t end, int nCoeffs, PartialSums &sums){
+    for (int64_t i = begin; i < end; i++){
+        double x = px[i];
+        double p = 1; //x^j
+        for (int j = 0; j < (nCoeffs*2)-1; j++){
+            sums.S[j].add(p);
+            if (j < nCoeffs) sums.T[j].add(py[i] * p);
+            p *= x;
         }
     }
+}
+
+//Split the points into threadCount chunks, each thread keeps compensated S/T sums,
+//then reduce them in chunk order so the result doesn't depend on scheduling
+int fitCurveParallel (int order, const vector<double> &px, const vector<double> &py, vector<double> &coeffs, int threadCount) {
+    int nCoeffs = order + 1;
+    int64_t n = px.size();
+    if (order < 1 || nCoeffs > MAX_ORDER) return ORDER_INCORRECT;
+    if (int(coeffs.size()) < nCoeffs) return ORDER_AND_NCOEFFS_DO_NOT_MATCH;
+    if (n < nCoeffs || int64_t(py.size()) != n) return NPOINTS_INCORRECT;
+    threadCount = max<int64_t>(1, min<int64_t>(threadCount, n));
+
+    vector<PartialSums> partials(threadCount);
+    vector<thread> workers;
+    int64_t chunk = (n + threadCount - 1) / threadCount;
+    for (int t = 1; t < threadCount; t++){
+        workers.emplace_back([&, t]{
+            accumulateChunk(px.data(), py.data(), t * chunk, min(n, (t + 1) * chunk), nCoeffs, partials[t]);
+        });
+    }
+    accumulateChunk(px.data(), py.data(), 0, min(n, chunk), nCoeffs, partials[0]);
+    for (auto &worker : workers){
+        worker.join();
+    }
 
-    double mat[nCoeffs*nCoeffs]; //Temp matrix as det() method alters the matrix given
-    cpyArray(masterMat, mat, nCoeffs);
-    denom = det(mat, nCoeffs);
-    cpyArray(masterMat, mat, nCoeffs);
+    PartialSums total;
+    for (auto &partial : partials){
+        for (int j = 0; j < (nCoeffs*2)-1; j++) total.S[j].add(partial.S[j].value());
+        for (int j = 0; j < nCoeffs; j++) total.T[j].add(partial.T[j].value());
+    }
+    double S[MAX_ORDER*2+1] = {0}, T[MAX_ORDER] = {0};
+    for (int j = 0; j < (nCoeffs*2)-1; j++) S[j] = total.S[j].value();
+    for (int j = 0; j < nCoeffs; j++) T[j] = total.T[j].value();
 
-    //Generate cramers rule mats
-    for (i = 0; i < nCoeffs; i++){ //Temporary matrix to substitute RHS of linear equation as per Cramer's rule
-        subCol(mat, T, i, nCoeffs);
-        coeffs[nCoeffs-i-1] = det(mat, nCoeffs)/denom; //Coefficients are det(M_i)/det(Master)
-        cpyArray(masterMat, mat, nCoeffs);
+    double m[MAX_ORDER*MAX_ORDER], a[MAX_ORDER];
+    if (!solveNormalEquations(S, T, nCoeffs, m, a)) return NPOINTS_INCORRECT;
+    for (int i = 0; i < nCoeffs; i++){
+        coeffs[nCoeffs-i-1] = a[i];
     }
     return 0;
-} 
+}
+
+#define EVAL_BLOCK 8
+
+//Horner's scheme over a block of EVAL_BLOCK points at a time, the inner loops have a
+//fixed trip count and no dependency between points, so they compile to SIMD lanes.
+//coeffs are highest order first, as fitCurve writes them
+void evalCurve(int order, const vector<double> &coeffs, const double *px, double *py, int64_t n){
+    int64_t i = 0;
+    for (; i + EVAL_BLOCK <= n; i += EVAL_BLOCK){
+        double acc[EVAL_BLOCK];
+        for (int k = 0; k < EVAL_BLOCK; k++) acc[k] = coeffs[0];
+        for (int j = 1; j <= order; j++){
+            double c = coeffs[j];
+            for (int k = 0; k < EVAL_BLOCK; k++) acc[k] = acc[k] * px[i+k] + c;
+        }
+        for (int k = 0; k < EVAL_BLOCK; k++) py[i+k] = acc[k];
+    }
+    for (; i < n; i++){
+        double acc = coeffs[0];
+        for (int j = 1; j <= order; j++) acc = acc * px[i] + coeffs[j];
+        py[i] = acc;
+    }
+}
+
+void evalCurve(int order, const vector<double> &coeffs, const vector<double> &px, vector<double> &py){
+    py.resize(px.size());
+    evalCurve(order, coeffs, px.data(), py.data(), px.size());
+}
+
+struct CurveFitStats {
+    double sse = 0; //sum of squared residuals
+    double r2 = 0;
+    double maxResidual = 0; //max |y - f(x)|
+};
+
+//One pass evaluates the fit and accumulates SSE, max residual and the shifted sums for SST,
+//y is shifted by py[0] so sum(y^2) - sum(y)^2/n doesn't cancel for large offsets
+CurveFitStats curveFitStats(int order, const vector<double> &coeffs, const vector<double> &px, const vector<double> &py){
+    CurveFitStats stats;
+    int64_t n = px.size();
+    if (n == 0) return stats;
+    double shift = py[0];
+    double sse[EVAL_BLOCK] = {0}, maxR[EVAL_BLOCK] = {0}, sy[EVAL_BLOCK] = {0}, syy[EVAL_BLOCK] = {0};
+    int64_t i = 0;
+    for (; i + EVAL_BLOCK <= n; i += EVAL_BLOCK){
+        double acc[EVAL_BLOCK];
+        for (int k = 0; k < EVAL_BLOCK; k++) acc[k] = coeffs[0];
+        for (int j = 1; j <= order; j++){
+            double c = coeffs[j];
+            for (int k = 0; k < EVAL_BLOCK; k++) acc[k] = acc[k] * px[i+k] + c;
+        }
+        for (int k = 0; k < EVAL_BLOCK; k++){
+            double r = py[i+k] - acc[k];
+            double y = py[i+k] - shift;
+            sse[k] += r * r;
+            maxR[k] = max(maxR[k], fabs(r));
+            sy[k] += y;
+            syy[k] += y * y;
+        }
+    }
+    for (; i < n; i++){
+        double acc = coeffs[0];
+        for (int j = 1; j <= order; j++) acc = acc * px[i] + coeffs[j];
+        double r = py[i] - acc;
+        double y = py[i] - shift;
+        sse[0] += r * r;
+        maxR[0] = max(maxR[0], fabs(r));
+        sy[0] += y;
+        syy[0] += y * y;
+    }
+    double sumY = 0, sumYY = 0;
+    for (int k = 0; k < EVAL_BLOCK; k++){
+        stats.sse += sse[k];
+        stats.maxResidual = max(stats.maxResidual, maxR[k]);
+        sumY += sy[k];
+        sumYY += syy[k];
+    }
+    double sst = sumYY - sumY * sumY / n;
+    stats.r2 = sst > 0 ? 1 - stats.sse / sst : 1;
+    return stats;
+}
+
+//y = 3 + 2e-3*x - 1e-9*x^2 over x = 0..n-1, both overloads should recover 3, 2e-3, -1e-9
+void testImplicitXLargeN(int n) {
+    cout << "test implicit x n = " << n << endl;
+    cout << setprecision(12);
+    vector<double> vx(n), vy(n);
+    for (int i = 0; i < n; i++) {
+        vx[i] = i;
+        vy[i] = 3 + 2e-3 * i - 1e-9 * i * i;
+    }
+    {
+        vector<double> coeffs(3);
+        Timer t("explicit x");
+        fitCurve(2, vx, vy, coeffs);
+        cout << coeffs[0] << " " << coeffs[1] << " " << coeffs[2] << endl;
+    }
+    {
+        vector<double> coeffs(3);
+        Timer t("implicit x");
+        fitCurve(2, vy, coeffs);
+        cout << coeffs[0] << " " << coeffs[1] << " " << coeffs[2] << endl;
+    }
+    cout << setprecision(6);
+}
+
+//random x in [0, 10), y = 1 + 0.5x - 0.25x^2 + 0.01x^3 plus noise
+void testParallelScaling(int n) {
+    cout << "test parallel scaling n = " << n << endl;
+    vector<double> vx(n), vy(n);
+    for (int i = 0; i < n; i++) {
+        vx[i] = rand() % 10000 / 1000.0;
+        vy[i] = 1 + 0.5 * vx[i] - 0.25 * vx[i] * vx[i] + 0.01 * vx[i] * vx[i] * vx[i] + (rand() % 1000 - 500) / 1e5;
+    }
+    cout << setprecision(12);
+    {
+        vector<double> coeffs(4);
+        Timer t("serial");
+        fitCurve(3, vx, vy, coeffs);
+        cout << coeffs[0] << " " << coeffs[1] << " " << coeffs[2] << " " << coeffs[3] << endl;
+    }
+    int maxThreads = max(1u, thread::hardware_concurrency());
+    for (int threads = 1;; threads = min(threads * 2, maxThreads)) {
+        vector<double> coeffs(4);
+        Timer t("parallel threads = " + to_string(threads));
+        fitCurveParallel(3, vx, vy, coeffs, threads);
+        cout << coeffs[0] << " " << coeffs[1] << " " << coeffs[2] << " " << coeffs[3] << endl;
+        if (threads == maxThreads) break;
+    }
+    cout << setprecision(6);
+}
+
+void testEvalAndStats(int n) {
+    cout << "test eval and stats n = " << n << endl;
+    vector<double> vx(n), vy(n);
+    for (int i = 0; i < n; i++) {
+        vx[i] = rand() % 10000 / 1000.0;
+        vy[i] = 1 + 0.5 * vx[i] - 0.25 * vx[i] * vx[i] + 0.01 * vx[i] * vx[i] * vx[i] + (rand() % 1000 - 500) / 1e3;
+    }
+    vector<double> coeffs(4);
+    fitCurve(3, vx, vy, coeffs);
+    vector<double> naive(n), horner(n);
+    {
+        Timer t("naive pow eval");
+        for (int i = 0; i < n; i++) {
+            naive[i] = 0;
+            for (int j = 0; j <= 3; j++) naive[i] += coeffs[3-j] * pow(vx[i], j);
+        }
+    }
+    {
+        Timer t("horner eval");
+        evalCurve(3, coeffs, vx, horner);
+    }
+    double maxDiff = 0;
+    for (int i = 0; i < n; i++) maxDiff = max(maxDiff, fabs(naive[i] - horner[i]));
+    cout << "max diff " << maxDiff << endl;
+    {
+        Timer t("eval then stats");
+        evalCurve(3, coeffs, vx, horner);
+        double sse = 0, maxR = 0, mean = 0, sst = 0;
+        for (int i = 0; i < n; i++) mean += vy[i] / n;
+        for (int i = 0; i < n; i++) {
+            double r = vy[i] - horner[i];
+            sse += r * r;
+            maxR = max(maxR, fabs(r));
+            sst += (vy[i] - mean) * (vy[i] - mean);
+        }
+        cout << "sse " << sse << " r2 " << 1 - sse / sst << " max residual " << maxR << endl;
+    }
+    {
+        Timer t("fused stats");
+        auto stats = curveFitStats(3, coeffs, vx, vy);
+        cout << "sse " << stats.sse << " r2 " << stats.r2 << " max residual " << stats.maxResidual << endl;
+    }
+}
+
+//y = 1 + 0.5x - 0.25x^2 plus noise, every 20th point is an outlier shifted by +50
+void testRobust(int n) {
+    cout << "test robust n = " << n << endl;
+    vector<double> vx(n), vy(n), vw(n);
+    for (int i = 0; i < n; i++) {
+        vx[i] = rand() % 10000 / 1000.0;
+        vy[i] = 1 + 0.5 * vx[i] - 0.25 * vx[i] * vx[i] + (rand() % 1000 - 500) / 1e4;
+        vw[i] = 1;
+        if (i % 20 == 0) {
+            vy[i] += 50;
+            vw[i] = 0;
+        }
+    }
+    auto show = [](const string &name, const vector<double> &coeffs) {
+        cout << name << " " << coeffs[0] << " " << coeffs[1] << " " << coeffs[2] << endl;
+    };
+    vector<double> coeffs(3);
+    {
+        Timer t("ols");
+        fitCurve(2, vx, vy, coeffs);
+    }
+    show("ols", coeffs);
+    {
+        Timer t("weighted, outliers w = 0");
+        fitCurveWeighted(2, vx, vy, vw, coeffs);
+    }
+    show("weighted", coeffs);
+    {
+        Timer t("huber");
+        fitCurveRobust(2, vx, vy, coeffs, LOSS_HUBER);
+    }
+    show("huber", coeffs);
+    {
+        Timer t("tukey");
+        fitCurveRobust(2, vx, vy, coeffs, LOSS_TUKEY);
+    }
+    show("tukey", coeffs);
+}
+
+template <int Order>
+void testFixedOrder(int n, int repeat) {
+    cout << "test fixed order " << Order << " n = " << n << " repeat = " << repeat << endl;
+    vector<double> vx(n), vy(n);
+    for (int i = 0; i < n; i++) {
+        vx[i] = rand() % 10000 / 1000.0;
+        vy[i] = 1 + 0.5 * vx[i] - 0.25 * vx[i] * vx[i] + (rand() % 1000 - 500) / 1e3;
+    }
+    vector<double> generic(Order + 1), fixed(Order + 1);
+    {
+        Timer t("generic");
+        for (int r = 0; r < repeat; r++) fitCurveGeneric(Order, vx, vy, generic);
+    }
+    {
+        Timer t("fixed");
+        for (int r = 0; r < repeat; r++) fitCurve<Order>(vx, vy, fixed);
+    }
+    double maxDiff = 0;
+    for (int i = 0; i <= Order; i++) maxDiff = max(maxDiff, fabs(generic[i] - fixed[i]));
+    cout << "max coeff diff " << maxDiff << endl;
+
+    //The solve alone on this data's sums, T[0] moves every round so it can't be hoisted
+    constexpr int nCoeffs = Order + 1;
+    array<double, nCoeffs*2-1> S;
+    array<double, nCoeffs> T, a;
+    accumulateWeighted(nCoeffs, vx, vy, nullptr, S.data(), T.data());
+    double t0 = T[0], m[nCoeffs*nCoeffs], sink = 0;
+    int solveRepeat = 1000000;
+    {
+        Timer t("runtime solve");
+        for (int r = 0; r < solveRepeat; r++) {
+            T[0] = t0 + r * 1e-9;
+            solveNormalEquations(S.data(), T.data(), nCoeffs, m, a.data());
+            sink += a[0];
+        }
+    }
+    {
+        Timer t("fixed solve");
+        for (int r = 0; r < solveRepeat; r++) {
+            T[0] = t0 + r * 1e-9;
+            solveNormalEquationsFixed<nCoeffs>(S, T, a);
+            sink -= a[0];
+        }
+    }
+    cout << "solve repeat " << solveRepeat << " sink " << sink << endl;
+}
+
 int main() {
     vector<double> vx = {0,0.25,0,5,0.75};
         vector<double> vy = {1,1.283,1.649,2.212,2.178};
@@ -178,4 +672,16 @@ int main() {
             cout << v << endl;
         }
     }
+    testImplicitXLargeN(1000);
+    testImplicitXLargeN(1000000);
+    testImplicitXLargeN(1000001);
+    testParallelScaling(4000000);
+    testEvalAndStats(4000000);
+    testFixedOrder<1>(1000000, 10);
+    testFixedOrder<2>(1000000, 10);
+    testFixedOrder<3>(1000000, 10);
+    testFixedOrder<1>(64, 100000);
+    testFixedOrder<2>(64, 100000);
+    testFixedOrder<3>(64, 100000);
+    testRobust(1000000);
 }
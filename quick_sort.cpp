@@ -8,6 +8,20 @@
 //7 测试和nth_element性能区别
 
 #include "/root/env/snippets/cpp/cpp_test_common.h"
+#include "pdq_sort.h"
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+//std::execution::par的对比需要编译时加-DQUICK_SORT_WITH_PSTL -ltbb
+#ifdef QUICK_SORT_WITH_PSTL
+#include <execution>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 //helper
 inline void print(const vector<int> &nums, uint64_t start = 0, uint64_t end = 0) {
@@ -44,6 +58,49 @@ vector<int> getOrderedVector() {
     }
     return nums;
 }
+vector<int> getReverseVector() {
+    //100w数据，3.8MB
+    int testCount = 1000000;
+    vector<int> nums(testCount, 0);
+    for (int i = 0;i < testCount;i++) {
+        nums[i] = testCount - i;
+    }
+    return nums;
+}
+//先升后降
+vector<int> getOrganPipeVector() {
+    //100w数据，3.8MB
+    int testCount = 1000000;
+    vector<int> nums(testCount, 0);
+    for (int i = 0;i < testCount;i++) {
+        nums[i] = i < testCount / 2 ? i : testCount - i;
+    }
+    return nums;
+}
+//只有uniqueCount种取值，模拟状态码，分片id这类数据
+vector<int> getFewUniqueVector(int uniqueCount = 16) {
+    //100w数据，3.8MB
+    int testCount = 1000000;
+    vector<int> nums(testCount, 0);
+    for (int i = 0;i < testCount;i++) {
+        nums[i] = rand() % uniqueCount;
+    }
+    return nums;
+}
+//大部分有序，ratio比例的位置和随机位置交换，模拟追加了少量乱序记录的日志
+vector<int> getNearlySortedVector(double ratio) {
+    //100w数据，3.8MB
+    int testCount = 1000000;
+    vector<int> nums(testCount, 0);
+    for (int i = 0;i < testCount;i++) {
+        nums[i] = i;
+    }
+    int swapCount = testCount * ratio;
+    for (int i = 0;i < swapCount;i++) {
+        swap(nums[rand() % testCount], nums[rand() % testCount]);
+    }
+    return nums;
+}
 void testFuncOk(const string &testName, const function<void(vector<int>&)> &testFunc,
     const function<void(vector<int>&)> &stdFunc) {
     auto nums = getRandomVector();
@@ -56,20 +113,44 @@ void testFuncOk(const string &testName, const function<void(vector<int>&)> &test
     }
     cout << testName << " failed" << endl;
 }
-void randomTest(const string &testName, const function<void(vector<int>&)> &testFunc) {
-    cout << __FUNCTION__ << " " << testName << endl;
-    Timer t;
-    for (int count = 0;count < 10;count++) {
-        auto nums = getRandomVector();
-        testFunc(nums);
+//数据只生成一次，不计入耗时
+void patternTest(const string &testName, const string &patternName, const function<vector<int>()> &generator,
+    const function<void(vector<int>&)> &testFunc) {
+    cout << __FUNCTION__ << " " << patternName << " " << testName << endl;
+    auto origin = generator();
+    auto sorted = origin;
+    sort(sorted.begin(), sorted.end());
+    vector<int> nums;
+    {
+        Timer t;
+        for (int count = 0;count < 10;count++) {
+            nums = origin;
+            testFunc(nums);
+        }
+    }
+    if (nums != sorted) {
+        cout << testName << " failed" << endl;
     }
 }
-void orderedTest(const string &testName, const function<void(vector<int>&)> &testFunc) {
-    cout << __FUNCTION__ << " " << testName << endl;
-    Timer t;
-    for (int count = 0;count < 10;count++) {
-        auto nums = getOrderedVector();
-        testFunc(nums);
+void selectTest(const string &testName, const string &patternName, const function<vector<int>()> &generator,
+    const function<void(vector<int>&, int)> &selectFunc) {
+    cout << __FUNCTION__ << " " << patternName << " " << testName << endl;
+    auto origin = generator();
+    auto sorted = origin;
+    sort(sorted.begin(), sorted.end());
+    vector<int> nums;
+    bool ok = true;
+    {
+        Timer t;
+        for (int count = 0;count < 10;count++) {
+            nums = origin;
+            int k = rand() % nums.size();
+            selectFunc(nums, k);
+            ok = ok && nums[k] == sorted[k];
+        }
+    }
+    if (!ok) {
+        cout << testName << " failed" << endl;
     }
 }
 //helper end
@@ -340,47 +421,2298 @@ void stackoverflow_quick_sort(std::vector<int> &nums, int start, int end) {
 }
 //stackoverflow code end
 
+//intro sort
+//在stackoverflow的三点中值双向遍历分区上改造，这是上面几种里最快的:
+//1 pivot取start,middle,end三点中值，区间超过128个数时取ninther(三组三点中值的中值)
+//2 区间不超过16个数时不再递归，最后对整个数组做一次插入排序
+//3 递归深度超过2*log2(n)说明pivot一直取得很差，改用堆排序，保证最坏O(nlogn)
+//4 只递归较小的一半，较大的一半在循环里继续处理，栈深度不超过O(logn)
+#define INTRO_SORT_INSERTION_THRESHOLD 16
+#define INTRO_SORT_NINTHER_THRESHOLD 128
+
 template <typename T>
-void testFunc(const string &name, vector<int> nums, const T& f) {
-    LDEBUG(LOGV(name), "------------------------------", "start");
-    print(nums);
-    f(nums);
-    print(nums);
-    LDEBUG(LOGV(name), "------------------------------", "end");
+void insertion_sort(vector<T> &nums, int start, int end) {
+    for (int i = start + 1;i <= end;i++) {
+        T v = move(nums[i]);
+        int j = i - 1;
+        for (;j >= start && v < nums[j];j--) {
+            nums[j + 1] = move(nums[j]);
+        }
+        nums[j + 1] = move(v);
+    }
 }
 
-int main() {
-    srand(time(0));
+template <typename T>
+void heap_sift_down(vector<T> &nums, int start, int index, int size) {
+    T v = move(nums[start + index]);
+    while(true) {
+        int child = 2 * index + 1;
+        if (child >= size) {
+            break;
+        }
+        if (child + 1 < size && nums[start + child] < nums[start + child + 1]) {
+            child++;
+        }
+        if (!(v < nums[start + child])) {
+            break;
+        }
+        nums[start + index] = move(nums[start + child]);
+        index = child;
+    }
+    nums[start + index] = move(v);
+}
 
-    auto my_quick_sort = [&](vector<int> &nums){quick_sort(nums);};
-    auto my_random_quick_sort = [&](vector<int> &nums){random_quick_sort(nums);};
-    auto other_csdn_quick_sort = [&](vector<int> &nums){csdn_quick_sort(nums, 0, nums.size() - 1);};
-    auto other_lc_quick_sort = [&](vector<int> &nums){lc_quick_sort(nums, 0, nums.size() - 1);};
-    auto other_stackoverflow_quick_sort = [&](vector<int> &nums){stackoverflow_quick_sort(nums, 0, nums.size() - 1);};
-    auto std_quick_sort = [&](vector<int> &nums){sort(nums.begin(), nums.end());};
-    //vector<int> nums{3,2,1,6,4,1,2,3};
-    //vector<int> nums{3,2,1,3,2,1,1,2,3};
-    vector<int> nums{1,2};
-    testFunc("my normal", nums, my_quick_sort);
-    testFunc("my random", nums, my_random_quick_sort);
-    testFunc("csdn", nums, other_csdn_quick_sort);
-    testFunc("lc", nums, other_csdn_quick_sort);
-    testFunc("stackoverflow", nums, other_stackoverflow_quick_sort);
-    testFuncOk("my normal", my_quick_sort, std_quick_sort);
-    testFuncOk("my random", my_random_quick_sort, std_quick_sort);
-    testFuncOk("csdn", other_csdn_quick_sort, std_quick_sort);
-    testFuncOk("lc", other_lc_quick_sort, std_quick_sort);
-    testFuncOk("stackoverflow", other_stackoverflow_quick_sort, std_quick_sort);
-    randomTest("my normal", my_quick_sort);
-    randomTest("my random", my_random_quick_sort);
-    randomTest("csdn", other_csdn_quick_sort);
-    randomTest("lc", other_lc_quick_sort);
-    randomTest("stackoverflow", other_stackoverflow_quick_sort);
-    randomTest("std", std_quick_sort);
-    orderedTest("my normal", my_quick_sort);
-    orderedTest("my random", my_random_quick_sort);
-    orderedTest("csdn", other_csdn_quick_sort);
-    orderedTest("lc", other_lc_quick_sort);
-    orderedTest("stackoverflow", other_stackoverflow_quick_sort);
-    orderedTest("std", std_quick_sort);
+template <typename T>
+void heap_sort(vector<T> &nums, int start, int end) {
+    int size = end - start + 1;
+    for (int i = size / 2 - 1;i >= 0;i--) {
+        heap_sift_down(nums, start, i, size);
+    }
+    for (int i = size - 1;i > 0;i--) {
+        swap(nums[start], nums[start + i]);
+        heap_sift_down(nums, start, 0, i);
+    }
+}
+
+//把a,b,c三个位置排好序，中值落在b上
+template <typename T>
+void sort3(vector<T> &nums, int a, int b, int c) {
+    if (nums[b] < nums[a]) swap(nums[a], nums[b]);
+    if (nums[c] < nums[b]) swap(nums[b], nums[c]);
+    if (nums[b] < nums[a]) swap(nums[a], nums[b]);
+}
+
+//选出的pivot放在start上，分区和stackoverflow_partition一样
+template <typename T>
+int intro_sort_partition(vector<T> &nums, int start, int end) {
+    int size = end - start + 1;
+    int middle = start + size / 2;
+    if (size > INTRO_SORT_NINTHER_THRESHOLD) {
+        int step = size / 8;
+        sort3(nums, start, start + step, start + 2 * step);
+        sort3(nums, middle - step, middle, middle + step);
+        sort3(nums, end - 2 * step, end - step, end);
+        sort3(nums, start + step, middle, end - step);
+    }else {
+        sort3(nums, start, middle, end);
+    }
+    swap(nums[start], nums[middle]);
+    T pivot = nums[start];
+    int i = start - 1;
+    int j = end + 1;
+    while(true) {
+        do {
+            i++;
+        } while(nums[i] < pivot);
+        do {
+            j--;
+        } while(pivot < nums[j]);
+        if (i >= j) {
+            return j;
+        }
+        swap(nums[i], nums[j]);
+    }
+}
+
+template <typename T>
+void intro_sort_imp(vector<T> &nums, int start, int end, int depthLimit) {
+    while(end - start + 1 > INTRO_SORT_INSERTION_THRESHOLD) {
+        if (depthLimit-- == 0) {
+            heap_sort(nums, start, end);
+            return;
+        }
+        //[start, q]和[q + 1, end]
+        int q = intro_sort_partition(nums, start, end);
+        if (q - start < end - q) {
+            intro_sort_imp(nums, start, q, depthLimit);
+            start = q + 1;
+        }else {
+            intro_sort_imp(nums, q + 1, end, depthLimit);
+            end = q;
+        }
+    }
+}
+
+template <typename T>
+void intro_sort(vector<T> &nums) {
+    if (nums.size() < 2) {
+        return;
+    }
+    intro_sort_imp(nums, 0, nums.size() - 1, 2 * int(std::log2(nums.size())));
+    //小区间都留到最后，整体做一次插入排序，每个数最多移动INTRO_SORT_INSERTION_THRESHOLD次
+    //前INTRO_SORT_INSERTION_THRESHOLD个数之后，前面必然有不大于它的数，内层循环不用判断越界
+    int guarded = min<int>(nums.size(), INTRO_SORT_INSERTION_THRESHOLD);
+    insertion_sort(nums, 0, guarded - 1);
+    for (int i = guarded;i < int(nums.size());i++) {
+        T v = move(nums[i]);
+        int j = i - 1;
+        for (;v < nums[j];j--) {
+            nums[j + 1] = move(nums[j]);
+        }
+        nums[j + 1] = move(v);
+    }
+}
+//intro sort end
+
+//pdq sort，实现在pdq_sort.h
+template <typename T>
+void pdq_sort(vector<T> &nums) {
+    pdq_sort(nums.begin(), nums.end());
+}
+
+//three way quick sort
+//Bentley & McIlroy, Engineering a Sort Function
+//https://algs4.cs.princeton.edu/23quicksort/QuickBentleyMcIlroy.java.html
+//双向遍历时把等于pivot的数先交换到区间两头，遍历结束后再换回中间
+//分区结果是[start, lt) < pivot，[lt, gt] == pivot，(gt, end] > pivot
+//等于pivot的整段不再参与递归，取值很少的数据上，每一轮都能排除一大段
+template <typename T>
+void three_way_partition(vector<T> &nums, int start, int end, int pivotIndex, int &lt, int &gt) {
+    swap(nums[start], nums[pivotIndex]);
+    T pivot = nums[start];
+    int i = start, j = end + 1;
+    //[start, p]和[q, end]是等于pivot的数
+    int p = start, q = end + 1;
+    auto equal = [&](const T &v) {
+        return !(v < pivot) && !(pivot < v);
+    };
+    while(true) {
+        while(nums[++i] < pivot) {
+            if (i == end) break;
+        }
+        while(pivot < nums[--j]) {
+            if (j == start) break;
+        }
+        if (i == j && equal(nums[i])) {
+            swap(nums[++p], nums[i]);
+        }
+        if (i >= j) {
+            break;
+        }
+        swap(nums[i], nums[j]);
+        if (equal(nums[i])) swap(nums[++p], nums[i]);
+        if (equal(nums[j])) swap(nums[--q], nums[j]);
+    }
+    i = j + 1;
+    for (int k = start;k <= p;k++) {
+        swap(nums[k], nums[j--]);
+    }
+    for (int k = end;k >= q;k--) {
+        swap(nums[k], nums[i++]);
+    }
+    lt = j + 1;
+    gt = i - 1;
+}
+
+template <typename T>
+void three_way_sort_imp(vector<T> &nums, int start, int end) {
+    while(end - start + 1 > INTRO_SORT_INSERTION_THRESHOLD) {
+        int lt = 0, gt = 0;
+        int middle = start + (end - start) / 2;
+        sort3(nums, start, middle, end);
+        three_way_partition(nums, start, end, middle, lt, gt);
+        if (lt - start < end - gt) {
+            three_way_sort_imp(nums, start, lt - 1);
+            start = gt + 1;
+        }else {
+            three_way_sort_imp(nums, gt + 1, end);
+            end = lt - 1;
+        }
+    }
+    insertion_sort(nums, start, end);
+}
+
+template <typename T>
+void three_way_sort(vector<T> &nums) {
+    three_way_sort_imp(nums, 0, int(nums.size()) - 1);
+}
+
+//和nth_element一样，nums[k]放第k小的数，左边都不大于它，右边都不小于它
+//k落在等于pivot的那段里就直接结束
+template <typename T>
+void three_way_select(vector<T> &nums, int k) {
+    int start = 0, end = int(nums.size()) - 1;
+    while(end - start + 1 > INTRO_SORT_INSERTION_THRESHOLD) {
+        int lt = 0, gt = 0;
+        int middle = start + (end - start) / 2;
+        sort3(nums, start, middle, end);
+        three_way_partition(nums, start, end, middle, lt, gt);
+        if (k < lt) {
+            end = lt - 1;
+        }else if (k > gt) {
+            start = gt + 1;
+        }else {
+            return;
+        }
+    }
+    insertion_sort(nums, start, end);
+}
+//three way quick sort end
+
+//quick select
+//选择算法都和nth_element一样，结束后nums[k]是第k小的数(k从0开始)，左边都不大于它，右边都不小于它
+//快速选择，和快排用同一个分区，只进入k所在的一边，期望O(n)，有序数据上退化成O(n^2)
+void quick_select(vector<int> &nums, int k) {
+    int start = 0, end = int(nums.size()) - 1;
+    while(start < end) {
+        int q = quick_sort_partion(nums, start, end);
+        if (k < q) {
+            end = q - 1;
+        }else if (k > q) {
+            start = q + 1;
+        }else {
+            return;
+        }
+    }
+}
+
+//随机选pivot换到end上，再用同一个分区
+void random_quick_select(vector<int> &nums, int k) {
+    int start = 0, end = int(nums.size()) - 1;
+    while(start < end) {
+        int pivotIndex = (rand() % (end - start + 1)) + start;
+        swap(nums[pivotIndex], nums[end]);
+        int q = quick_sort_partion(nums, start, end);
+        if (k < q) {
+            end = q - 1;
+        }else if (k > q) {
+            start = q + 1;
+        }else {
+            return;
+        }
+    }
+}
+
+//median of medians，5个一组取中值，再递归取这些中值的中值作为pivot
+//这个pivot至少大于3/10的数，也至少小于3/10的数，最坏也是O(n)
+//简单版本: 中值拷贝到新数组里递归选择，再回到原数组里找这个值的位置
+template <typename T>
+void simple_median_of_medians_select_imp(vector<T> &nums, int start, int end, int k) {
+    while(end - start + 1 > 5) {
+        vector<T> medians;
+        medians.reserve((end - start) / 5 + 1);
+        for (int i = start;i <= end;i += 5) {
+            int groupEnd = min(i + 4, end);
+            insertion_sort(nums, i, groupEnd);
+            medians.push_back(nums[i + (groupEnd - i) / 2]);
+        }
+        int mid = (int(medians.size()) - 1) / 2;
+        simple_median_of_medians_select_imp(medians, 0, int(medians.size()) - 1, mid);
+        int pivotIndex = start;
+        while(nums[pivotIndex] < medians[mid] || medians[mid] < nums[pivotIndex]) {
+            pivotIndex++;
+        }
+        int lt = 0, gt = 0;
+        three_way_partition(nums, start, end, pivotIndex, lt, gt);
+        if (k < lt) {
+            end = lt - 1;
+        }else if (k > gt) {
+            start = gt + 1;
+        }else {
+            return;
+        }
+    }
+    insertion_sort(nums, start, end);
+}
+
+template <typename T>
+void simple_median_of_medians_select(vector<T> &nums, int k) {
+    simple_median_of_medians_select_imp(nums, 0, int(nums.size()) - 1, k);
+}
+
+//复杂版本: 不申请额外空间，每组的中值交换到区间最前面，在[start, start + groupCount)上原地递归选择
+template <typename T>
+void median_of_medians_select_imp(vector<T> &nums, int start, int end, int k);
+
+template <typename T>
+int median_of_medians_pivot(vector<T> &nums, int start, int end) {
+    int groupCount = 0;
+    for (int i = start;i <= end;i += 5) {
+        int groupEnd = min(i + 4, end);
+        insertion_sort(nums, i, groupEnd);
+        swap(nums[start + groupCount], nums[i + (groupEnd - i) / 2]);
+        groupCount++;
+    }
+    int mid = start + (groupCount - 1) / 2;
+    median_of_medians_select_imp(nums, start, start + groupCount - 1, mid);
+    return mid;
+}
+
+template <typename T>
+void median_of_medians_select_imp(vector<T> &nums, int start, int end, int k) {
+    while(end - start + 1 > 5) {
+        int pivotIndex = median_of_medians_pivot(nums, start, end);
+        int lt = 0, gt = 0;
+        three_way_partition(nums, start, end, pivotIndex, lt, gt);
+        if (k < lt) {
+            end = lt - 1;
+        }else if (k > gt) {
+            start = gt + 1;
+        }else {
+            return;
+        }
+    }
+    insertion_sort(nums, start, end);
+}
+
+template <typename T>
+void median_of_medians_select(vector<T> &nums, int k) {
+    median_of_medians_select_imp(nums, 0, int(nums.size()) - 1, k);
+}
+
+//intro select
+//平时用随机pivot的三路快速选择，一轮下来区间没有缩小到3/4以内算一次差的pivot
+//差的pivot累计超过log2(n)次，剩下的区间改用median of medians，最坏也是O(n)
+template <typename T>
+void intro_select(vector<T> &nums, int k) {
+    int start = 0, end = int(nums.size()) - 1;
+    int badAllowed = nums.size() < 2 ? 1 : int(std::log2(nums.size()));
+    while(end - start + 1 > INTRO_SORT_INSERTION_THRESHOLD) {
+        if (badAllowed == 0) {
+            median_of_medians_select_imp(nums, start, end, k);
+            return;
+        }
+        int size = end - start + 1;
+        int pivotIndex = (rand() % size) + start;
+        int lt = 0, gt = 0;
+        three_way_partition(nums, start, end, pivotIndex, lt, gt);
+        if (k < lt) {
+            end = lt - 1;
+        }else if (k > gt) {
+            start = gt + 1;
+        }else {
+            return;
+        }
+        if (end - start + 1 > size / 4 * 3) {
+            badAllowed--;
+        }
+    }
+    insertion_sort(nums, start, end);
+}
+
+//k相对n很小时，扫一遍维护k个数的小顶堆，绝大部分数只和堆顶比较一次就跳过
+#define TOP_K_HEAP_RATIO 1024
+
+//最大的k个数，nums可能会被重新排列，sorted为true时结果从大到小
+template <typename T>
+vector<T> top_k(vector<T> &nums, int k, bool sorted = false) {
+    k = max(0, min(k, int(nums.size())));
+    if (k == 0) {
+        return {};
+    }
+    int n = nums.size();
+    vector<T> results;
+    if (k <= n / TOP_K_HEAP_RATIO) {
+        results.assign(nums.begin(), nums.begin() + k);
+        make_heap(results.begin(), results.end(), greater<T>());
+        for (int i = k;i < n;i++) {
+            if (results.front() < nums[i]) {
+                pop_heap(results.begin(), results.end(), greater<T>());
+                results.back() = nums[i];
+                push_heap(results.begin(), results.end(), greater<T>());
+            }
+        }
+    }else {
+        intro_select(nums, n - k);
+        results.assign(nums.begin() + (n - k), nums.end());
+    }
+    if (sorted) {
+        pdq_sort(results);
+        reverse(results.begin(), results.end());
+    }
+    return results;
+}
+//quick select end
+
+//parallel sort
+//第一遍是sample sort，没有串行的O(n)分区
+//1 随机抽样排序，选出threadCount * PARALLEL_SORT_BUCKETS_PER_THREAD - 1个splitter，去重
+//2 数组按线程数切成连续的段，每个线程给自己那段算桶号并计数，按前缀和散到另一块buffer里
+//  splitter s_i对应两个桶: (s_{i-1}, s_i)和等于s_i的，等于s_i的桶不用排，重复很多的数据也不会挤进一个桶
+//3 桶之间已经有序，每个桶一个任务，桶比cutoff大时用pdq的分区切成两半，一半作为任务丢进线程池，另一半当前线程继续切
+//  区间小于cutoff后直接串行pdq排序，cutoff按线程数取，保证每个线程能分到多个任务
+//除了抽样和前缀和，每一步都是并行的，代价是多一块n个T的buffer和n个uint16_t的桶号
+class SortWorkerPool {
+public:
+    explicit SortWorkerPool(int threadCount) {
+        for (int i = 0;i < threadCount;i++) {
+            workers_.emplace_back([this]{run();});
+        }
+    }
+    ~SortWorkerPool() {
+        {
+            lock_guard<mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        for (auto &worker : workers_) {
+            worker.join();
+        }
+    }
+    void submit(function<void()> task) {
+        {
+            lock_guard<mutex> lock(mutex_);
+            pending_++;
+            tasks_.push_back(move(task));
+        }
+        cv_.notify_one();
+    }
+    //等待所有任务结束，包括任务里再提交的任务
+    void wait() {
+        unique_lock<mutex> lock(mutex_);
+        doneCv_.wait(lock, [this]{return pending_ == 0;});
+    }
+private:
+    void run() {
+        while(true) {
+            function<void()> task;
+            {
+                unique_lock<mutex> lock(mutex_);
+                cv_.wait(lock, [this]{return stop_ || !tasks_.empty();});
+                if (tasks_.empty()) {
+                    return;
+                }
+                task = move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+            {
+                lock_guard<mutex> lock(mutex_);
+                if (--pending_ == 0) {
+                    doneCv_.notify_all();
+                }
+            }
+        }
+    }
+    vector<thread> workers_;
+    deque<function<void()>> tasks_;
+    mutex mutex_;
+    condition_variable cv_;
+    condition_variable doneCv_;
+    int64_t pending_ = 0;
+    bool stop_ = false;
+};
+
+#define PARALLEL_SORT_MIN_CUTOFF (1 << 16)
+#define PARALLEL_SORT_BUCKETS_PER_THREAD 4
+//每个桶抽这么多个样本，桶的大小比较均匀
+#define PARALLEL_SORT_OVERSAMPLE 32
+
+//leftmost和pdq_sort_loop一样，为false时begin - 1上是之前的pivot，不大于区间里所有数
+template <typename T>
+void parallel_sort_imp(SortWorkerPool &pool, T *begin, T *end, int64_t cutoff, int bad_allowed, bool leftmost) {
+    std::less<T> comp;
+    while(end - begin > cutoff && bad_allowed > 0) {
+        int64_t size = end - begin;
+        int64_t s2 = size / 2;
+        pdq_sort3(begin, begin + s2, end - 1, comp);
+        pdq_sort3(begin + 1, begin + (s2 - 1), end - 2, comp);
+        pdq_sort3(begin + 2, begin + (s2 + 1), end - 3, comp);
+        pdq_sort3(begin + (s2 - 1), begin + s2, begin + (s2 + 1), comp);
+        swap(*begin, *(begin + s2));
+        if (!leftmost && !(*(begin - 1) < *begin)) {
+            begin = pdq_partition_left(begin, end, comp) + 1;
+            continue;
+        }
+
+        T *pivot_pos = pdq_partition_right_branchless(begin, end, comp).first;
+        int64_t l_size = pivot_pos - begin;
+        int64_t r_size = end - (pivot_pos + 1);
+        if (l_size < size / 8 || r_size < size / 8) {
+            bad_allowed--;
+        }
+        pool.submit([&pool, begin, pivot_pos, cutoff, bad_allowed, leftmost]{
+            parallel_sort_imp(pool, begin, pivot_pos, cutoff, bad_allowed, leftmost);
+        });
+        begin = pivot_pos + 1;
+        leftmost = false;
+    }
+    //pivot一直很差时也交给pdq，它自己会退化到堆排序
+    pdq_sort_loop<pdq_branchless<T*, std::less<T>>>(begin, end, comp, max(1, pdq_log2(end - begin)), leftmost);
+}
+
+template <typename T>
+void parallel_sort(vector<T> &nums, int threadCount = thread::hardware_concurrency()) {
+    threadCount = max(1, threadCount);
+    int64_t n = nums.size();
+    int64_t cutoff = max<int64_t>(PARALLEL_SORT_MIN_CUTOFF, n / (threadCount * 8));
+    if (threadCount == 1 || n <= cutoff) {
+        pdq_sort(nums);
+        return;
+    }
+    int bucketTarget = threadCount * PARALLEL_SORT_BUCKETS_PER_THREAD;
+    vector<T> splitters;
+    {
+        mt19937_64 rng(n);
+        vector<T> sample(bucketTarget * PARALLEL_SORT_OVERSAMPLE);
+        for (auto &v : sample) {
+            v = nums[rng() % n];
+        }
+        pdq_sort(sample);
+        for (int i = 1;i < bucketTarget;i++) {
+            auto &splitter = sample[i * PARALLEL_SORT_OVERSAMPLE];
+            if (splitters.empty() || splitters.back() < splitter) {
+                splitters.push_back(splitter);
+            }
+        }
+    }
+    int k = splitters.size();
+    //桶2i是(s_{i-1}, s_i)，桶2i + 1是等于s_i的
+    int bucketCount = 2 * k + 1;
+    int64_t chunk = (n + threadCount - 1) / threadCount;
+    vector<uint16_t> buckets(n);
+    //counts[t * bucketCount + b]先是第t段在桶b里的个数，前缀和之后是第t段往桶b写的位置
+    vector<int64_t> counts(int64_t(threadCount) * bucketCount);
+    SortWorkerPool pool(threadCount);
+    for (int t = 0;t < threadCount;t++) {
+        pool.submit([&, t]{
+            int64_t *count = &counts[int64_t(t) * bucketCount];
+            for (int64_t i = t * chunk;i < min(n, (t + 1) * chunk);i++) {
+                //无分支的lower_bound，splitter很少，全在L1里，比较结果用cmov
+                const T *base = splitters.data();
+                for (int len = k;len > 1;len -= len / 2) {
+                    base = base[len / 2] < nums[i] ? base + len / 2 : base;
+                }
+                int b = (base - splitters.data()) + (*base < nums[i]);
+                int bucket = 2 * b + (b < k && !(nums[i] < splitters[b]));
+                buckets[i] = bucket;
+                count[bucket]++;
+            }
+        });
+    }
+    pool.wait();
+    //同一个桶里按段的顺序放
+    vector<int64_t> bucketBegin(bucketCount + 1);
+    int64_t offset = 0;
+    for (int b = 0;b < bucketCount;b++) {
+        bucketBegin[b] = offset;
+        for (int t = 0;t < threadCount;t++) {
+            int64_t count = counts[int64_t(t) * bucketCount + b];
+            counts[int64_t(t) * bucketCount + b] = offset;
+            offset += count;
+        }
+    }
+    bucketBegin[bucketCount] = n;
+    vector<T> scattered(n);
+    for (int t = 0;t < threadCount;t++) {
+        pool.submit([&, t]{
+            int64_t *position = &counts[int64_t(t) * bucketCount];
+            for (int64_t i = t * chunk;i < min(n, (t + 1) * chunk);i++) {
+                scattered[position[buckets[i]]++] = move(nums[i]);
+            }
+        });
+    }
+    pool.wait();
+    for (int b = 0;b < bucketCount;b += 2) {
+        T *begin = scattered.data() + bucketBegin[b];
+        T *end = scattered.data() + bucketBegin[b + 1];
+        if (end - begin < 2) {
+            continue;
+        }
+        pool.submit([&pool, begin, end, cutoff]{
+            parallel_sort_imp(pool, begin, end, cutoff, int(std::log2(end - begin)), true);
+        });
+    }
+    pool.wait();
+    nums.swap(scattered);
+}
+//parallel sort end
+
+//radix sort
+//整数key按位拆成digit，有符号数把最高位取反，映射成无符号数后按位比较和大小顺序一致
+//LSD每轮要整体搬一遍数据，digit取11位，32位整数只要3轮，直方图2048项还放得进L1
+//MSD原地交换，桶太多时每个桶都很小，digit取8位
+#define LSD_RADIX_BITS 11
+#define MSD_RADIX_BITS 8
+//区间小于这个数时，MSD不再往下分桶，直接插入排序
+#define MSD_RADIX_INSERTION_THRESHOLD 64
+
+template <typename T>
+make_unsigned_t<T> radix_key(T v) {
+    using U = make_unsigned_t<T>;
+    if constexpr (is_signed_v<T>) {
+        return U(v) ^ (U(1) << (sizeof(T) * 8 - 1));
+    }else {
+        return U(v);
+    }
+}
+
+template <int Bits, typename T>
+int radix_digit(T v, int shift) {
+    return int((radix_key(v) >> shift) & ((1 << Bits) - 1));
+}
+
+//LSD: 从低位到高位，每一轮按一个digit稳定地分发到另一块buffer
+//所有轮的直方图在第一次遍历里一起算出来，某一轮所有数的digit都相同时跳过这一轮
+//keyOf从元素里取出整数key，元素可以是带下标或者payload的小结构
+template <typename T, typename KeyOf>
+void lsd_radix_sort_by_key(vector<T> &nums, KeyOf keyOf) {
+    using K = decay_t<decltype(keyOf(nums[0]))>;
+    constexpr int passes = (sizeof(K) * 8 + LSD_RADIX_BITS - 1) / LSD_RADIX_BITS;
+    int64_t n = nums.size();
+    if (n < 2) {
+        return;
+    }
+    vector<array<int64_t, (1 << LSD_RADIX_BITS)>> counts(passes);
+    for (auto &count : counts) {
+        count.fill(0);
+    }
+    for (auto &v : nums) {
+        for (int pass = 0;pass < passes;pass++) {
+            counts[pass][radix_digit<LSD_RADIX_BITS>(keyOf(v), pass * LSD_RADIX_BITS)]++;
+        }
+    }
+    vector<T> buffer(n);
+    for (int pass = 0;pass < passes;pass++) {
+        int shift = pass * LSD_RADIX_BITS;
+        auto &count = counts[pass];
+        if (count[radix_digit<LSD_RADIX_BITS>(keyOf(nums[0]), shift)] == n) {
+            continue;
+        }
+        int64_t offset = 0;
+        for (auto &c : count) {
+            int64_t next = offset + c;
+            c = offset;
+            offset = next;
+        }
+        for (auto &v : nums) {
+            buffer[count[radix_digit<LSD_RADIX_BITS>(keyOf(v), shift)]++] = v;
+        }
+        nums.swap(buffer);
+    }
+}
+
+template <typename T>
+void lsd_radix_sort(vector<T> &nums) {
+    lsd_radix_sort_by_key(nums, [](const T &v){return v;});
+}
+
+//MSD American flag sort: 从高位开始，按digit原地交换到各自的桶里，再对每个桶递归下一个digit
+//不需要额外的buffer，适合内存紧张的场景，但不是稳定排序
+template <typename T>
+void american_flag_sort_imp(T *begin, T *end, int shift) {
+    int64_t n = end - begin;
+    if (n <= MSD_RADIX_INSERTION_THRESHOLD) {
+        pdq_insertion_sort(begin, end, std::less<T>());
+        return;
+    }
+    array<int64_t, (1 << MSD_RADIX_BITS)> count{};
+    for (T *p = begin;p != end;p++) {
+        count[radix_digit<MSD_RADIX_BITS>(*p, shift)]++;
+    }
+    //所有数在这一位上都相同，直接看下一位
+    if (count[radix_digit<MSD_RADIX_BITS>(*begin, shift)] == n) {
+        if (shift > 0) {
+            american_flag_sort_imp(begin, end, shift - MSD_RADIX_BITS);
+        }
+        return;
+    }
+    array<int64_t, (1 << MSD_RADIX_BITS)> head, tail;
+    int64_t offset = 0;
+    for (int d = 0;d < (1 << MSD_RADIX_BITS);d++) {
+        head[d] = offset;
+        offset += count[d];
+        tail[d] = offset;
+    }
+    //每个桶从头往后填，拿出来的数一直交换到它该去的桶，直到换回一个属于当前桶的数
+    for (int d = 0;d < (1 << MSD_RADIX_BITS);d++) {
+        while(head[d] < tail[d]) {
+            T v = move(begin[head[d]]);
+            int digit = radix_digit<MSD_RADIX_BITS>(v, shift);
+            while(digit != d) {
+                swap(v, begin[head[digit]++]);
+                digit = radix_digit<MSD_RADIX_BITS>(v, shift);
+            }
+            begin[head[d]++] = move(v);
+        }
+    }
+    if (shift == 0) {
+        return;
+    }
+    offset = 0;
+    for (int d = 0;d < (1 << MSD_RADIX_BITS);d++) {
+        if (count[d] > 1) {
+            american_flag_sort_imp(begin + offset, begin + offset + count[d], shift - MSD_RADIX_BITS);
+        }
+        offset += count[d];
+    }
+}
+
+template <typename T>
+void msd_radix_sort(vector<T> &nums) {
+    constexpr int passes = (sizeof(T) * 8 + MSD_RADIX_BITS - 1) / MSD_RADIX_BITS;
+    american_flag_sort_imp(nums.data(), nums.data() + nums.size(), (passes - 1) * MSD_RADIX_BITS);
+}
+
+//整数类型且数据量够大时走LSD radix，其它走pdq
+#define RADIX_SORT_THRESHOLD 1024
+template <typename T>
+void fast_sort(vector<T> &nums) {
+    if constexpr (is_integral_v<T> && !is_same_v<T, bool>) {
+        if (nums.size() >= RADIX_SORT_THRESHOLD) {
+            lsd_radix_sort(nums);
+            return;
+        }
+    }
+    pdq_sort(nums);
+}
+//radix sort end
+
+//simd sort
+//编译时加-mavx2才会走AVX2，否则全部是标量实现
+//1 小区间(<=64个int)用寄存器里的bitonic排序网络，8个int一个寄存器，最多8个寄存器
+//  排序网络的比较次数固定，没有分支，min/max一次处理8对
+//2 分区时每次读8个数，和pivot比较得到8位掩码，查表得到把<=pivot的数排到前面的置换
+//  置换后整块写到左边和右边各一次，左边只前进<=pivot的个数，右边只后退>pivot的个数
+#define SIMD_SORT_NETWORK_THRESHOLD 64
+
+//标量版本，没有AVX2时用，也是benchmark的对照
+int *scalar_partition(int *begin, int *end, int pivot) {
+    int *l = begin;
+    for (int *p = begin;p != end;p++) {
+        if (*p <= pivot) {
+            swap(*p, *l++);
+        }
+    }
+    return l;
+}
+
+#ifdef __AVX2__
+//每个lane和lane ^ Mask比较，两个lane里下标小的取min，Mask的最高位就是区分大小下标的那一位
+template <int Mask>
+inline __m256i simd_network_step(__m256i v) {
+    constexpr int highBit = Mask >= 4 ? 4 : (Mask >= 2 ? 2 : 1);
+    constexpr int blend = highBit == 4 ? 0xF0 : (highBit == 2 ? 0xCC : 0xAA);
+    __m256i idx = _mm256_setr_epi32(0 ^ Mask, 1 ^ Mask, 2 ^ Mask, 3 ^ Mask, 4 ^ Mask, 5 ^ Mask, 6 ^ Mask, 7 ^ Mask);
+    __m256i p = _mm256_permutevar8x32_epi32(v, idx);
+    return _mm256_blend_epi32(_mm256_min_epi32(v, p), _mm256_max_epi32(v, p), blend);
+}
+
+inline __m256i simd_network_step(__m256i v, int mask) {
+    switch (mask) {
+    case 1: return simd_network_step<1>(v);
+    case 2: return simd_network_step<2>(v);
+    case 3: return simd_network_step<3>(v);
+    case 4: return simd_network_step<4>(v);
+    default: return simd_network_step<7>(v);
+    }
+}
+
+inline __m256i simd_reverse(__m256i v) {
+    return _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+}
+
+//N个寄存器共8N个数，第e个数在r[e / 8]的第e % 8个lane
+//bitonic排序的变形: 每轮先和镜像位置(e ^ (k - 1))比较，之后的半清洗(e ^ j)都是小下标取min，不用区分升降序
+template <int N>
+inline void simd_bitonic_sort(__m256i *r) {
+    for (int k = 2;k <= 8 * N;k *= 2) {
+        if (k <= 8) {
+            for (int i = 0;i < N;i++) r[i] = simd_network_step(r[i], k - 1);
+        }else {
+            int blockRegs = k / 8;
+            for (int b = 0;b < N;b += blockRegs) {
+                for (int i = 0;i < blockRegs / 2;i++) {
+                    __m256i &lo = r[b + i];
+                    __m256i &hi = r[b + blockRegs - 1 - i];
+                    __m256i rev = simd_reverse(hi);
+                    __m256i mx = _mm256_max_epi32(lo, rev);
+                    lo = _mm256_min_epi32(lo, rev);
+                    hi = simd_reverse(mx);
+                }
+            }
+        }
+        for (int j = k / 4;j >= 1;j /= 2) {
+            if (j >= 8) {
+                int jr = j / 8;
+                for (int i = 0;i < N;i++) {
+                    if (i & jr) continue;
+                    __m256i mn = _mm256_min_epi32(r[i], r[i | jr]);
+                    r[i | jr] = _mm256_max_epi32(r[i], r[i | jr]);
+                    r[i] = mn;
+                }
+            }else {
+                for (int i = 0;i < N;i++) r[i] = simd_network_step(r[i], j);
+            }
+        }
+    }
+}
+
+template <int N>
+inline void simd_network_sort(int *p, int n) {
+    alignas(32) int buffer[8 * N];
+    __m256i r[N];
+    if (n == 8 * N) {
+        for (int i = 0;i < N;i++) r[i] = _mm256_loadu_si256((__m256i*)(p + 8 * i));
+    }else {
+        //不满的部分填INT_MAX，排序后都在末尾
+        memcpy(buffer, p, n * sizeof(int));
+        fill(buffer + n, buffer + 8 * N, INT_MAX);
+        for (int i = 0;i < N;i++) r[i] = _mm256_load_si256((__m256i*)(buffer + 8 * i));
+    }
+    simd_bitonic_sort<N>(r);
+    if (n == 8 * N) {
+        for (int i = 0;i < N;i++) _mm256_storeu_si256((__m256i*)(p + 8 * i), r[i]);
+    }else {
+        for (int i = 0;i < N;i++) _mm256_store_si256((__m256i*)(buffer + 8 * i), r[i]);
+        memcpy(p, buffer, n * sizeof(int));
+    }
+}
+
+//掩码第i位为1表示第i个数>pivot，置换把为0的lane按顺序排前面，为1的排后面
+const __m256i *simd_partition_lut() {
+    struct Table {
+        alignas(32) int idx[256][8];
+    };
+    static const Table lut = [] {
+        Table table;
+        for (int mask = 0;mask < 256;mask++) {
+            int pos = 0;
+            for (int i = 0;i < 8;i++) if (!(mask & (1 << i))) table.idx[mask][pos++] = i;
+            for (int i = 0;i < 8;i++) if (mask & (1 << i)) table.idx[mask][pos++] = i;
+        }
+        return table;
+    }();
+    return (const __m256i*)lut.idx;
+}
+
+inline void simd_partition_store(__m256i v, __m256i pivot, const __m256i *lut, int *&l, int *&r) {
+    int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(v, pivot)));
+    __m256i permuted = _mm256_permutevar8x32_epi32(v, lut[mask]);
+    int greater = __builtin_popcount(mask);
+    _mm256_storeu_si256((__m256i*)l, permuted);
+    l += 8 - greater;
+    _mm256_storeu_si256((__m256i*)(r - 8), permuted);
+    r -= greater;
+}
+#endif
+
+//区间小于等于SIMD_SORT_NETWORK_THRESHOLD时调用
+void simd_sort_small(int *p, int n) {
+#ifdef __AVX2__
+    if (n <= 8) simd_network_sort<1>(p, n);
+    else if (n <= 16) simd_network_sort<2>(p, n);
+    else if (n <= 32) simd_network_sort<4>(p, n);
+    else simd_network_sort<8>(p, n);
+#else
+    pdq_insertion_sort(p, p + n, std::less<int>());
+#endif
+}
+
+//结束后[begin, mid) <= pivot, [mid, end) > pivot
+//先把头尾各8个数存进寄存器，腾出16个位置，之后每次从空位少的一边读8个数
+//读完这一边的空位至少8个，另一边也至少8个，两次整块写都不会覆盖没读过的数
+int *simd_partition(int *begin, int *end, int pivot) {
+#ifdef __AVX2__
+    if (end - begin < 16) {
+        return scalar_partition(begin, end, pivot);
+    }
+    const __m256i *lut = simd_partition_lut();
+    __m256i pv = _mm256_set1_epi32(pivot);
+    __m256i savedL = _mm256_loadu_si256((__m256i*)begin);
+    __m256i savedR = _mm256_loadu_si256((__m256i*)(end - 8));
+    int *l = begin, *r = end;
+    int *readL = begin + 8, *readR = end - 8;
+    while(readR - readL >= 8) {
+        __m256i v;
+        if (readL - l <= r - readR) {
+            v = _mm256_loadu_si256((__m256i*)readL);
+            readL += 8;
+        }else {
+            readR -= 8;
+            v = _mm256_loadu_si256((__m256i*)readR);
+        }
+        simd_partition_store(v, pv, lut, l, r);
+    }
+    //剩下不到8个数，先拿出来再逐个放
+    int rest[8];
+    int restCount = readR - readL;
+    memcpy(rest, readL, restCount * sizeof(int));
+    for (int i = 0;i < restCount;i++) {
+        if (rest[i] <= pivot) *l++ = rest[i];
+        else *--r = rest[i];
+    }
+    //这时[l, r)全是空位，正好16个
+    simd_partition_store(savedL, pv, lut, l, r);
+    simd_partition_store(savedR, pv, lut, l, r);
+    return l;
+#else
+    return scalar_partition(begin, end, pivot);
+#endif
+}
+
+void simd_quick_sort_imp(int *begin, int *end, int depthLimit) {
+    while(end - begin > SIMD_SORT_NETWORK_THRESHOLD) {
+        if (depthLimit-- == 0) {
+            make_heap(begin, end);
+            sort_heap(begin, end);
+            return;
+        }
+        int64_t s2 = (end - begin) / 2;
+        int a = begin[0], b = begin[s2], c = end[-1];
+        int pivot = max(min(a, b), min(max(a, b), c));
+        int *mid = simd_partition(begin, end, pivot);
+        //pivot是区间最大值，再按< pivot分一次，右边全等于pivot，不用再排
+        if (mid == end) {
+            if (pivot == INT_MIN) {
+                return;
+            }
+            end = simd_partition(begin, end, pivot - 1);
+            continue;
+        }
+        if (mid - begin < end - mid) {
+            simd_quick_sort_imp(begin, mid, depthLimit);
+            begin = mid;
+        }else {
+            simd_quick_sort_imp(mid, end, depthLimit);
+            end = mid;
+        }
+    }
+    simd_sort_small(begin, end - begin);
+}
+
+void simd_quick_sort(vector<int> &nums) {
+    if (nums.size() < 2) {
+        return;
+    }
+    simd_quick_sort_imp(nums.data(), nums.data() + nums.size(), 2 * pdq_log2(nums.size()));
+}
+//simd sort end
+
+//external sort
+//数据放不进内存时用，输入输出都是T的二进制文件，读写失败时返回false
+//1 每次顺序读一大段，fast_sort排好后写成一个run文件
+//  LSD radix要一块同样大的buffer，所以一段只占memoryBytes的一半
+//2 用败者树k路归并所有run，每次出一个数只要和log(k)个败者比较
+//  每个run后台线程预读下一块，输出也是一块在写盘时填另一块，读写和比较重叠
+//run比一次能归并的个数多时先分组归并成更长的run，再继续归并
+//归并时每个run和输出各两块，总共不超过memoryBytes，块又不能小于EXTERNAL_SORT_MIN_BLOCK_BYTES
+//所以一次归并的个数由memoryBytes决定，最多EXTERNAL_SORT_MAX_FAN_IN，连2个都放不下时直接返回false
+#define EXTERNAL_SORT_MAX_FAN_IN 256
+//块太小时多个run交替读，顺序读退化成随机读
+#define EXTERNAL_SORT_MIN_BLOCK_BYTES (64 << 10)
+
+inline size_t external_sort_fan_in(size_t memoryBytes) {
+    size_t blocks = memoryBytes / (2 * EXTERNAL_SORT_MIN_BLOCK_BYTES);
+    return blocks < 3 ? 0 : min<size_t>(EXTERNAL_SORT_MAX_FAN_IN, blocks - 1);
+}
+
+template <typename T>
+class ExternalRunReader {
+public:
+    ExternalRunReader(const string &path, size_t blockSize) : current_(blockSize), next_(blockSize) {
+        file_ = fopen(path.c_str(), "rb");
+        if (file_) {
+            prefetch();
+            advance();
+        }
+    }
+    ~ExternalRunReader() {
+        if (pending_.valid()) {
+            pending_.wait();
+        }
+        if (file_) {
+            fclose(file_);
+        }
+    }
+    bool ok() const {return file_ && !ferror(file_);}
+    bool empty() const {return pos_ == size_;}
+    const T &front() const {return current_[pos_];}
+    void pop() {
+        if (++pos_ == size_) {
+            advance();
+        }
+    }
+private:
+    void prefetch() {
+        pending_ = async(launch::async, [this]{return fread(next_.data(), sizeof(T), next_.size(), file_);});
+    }
+    void advance() {
+        //上一块没读满说明已经到文件尾，没有预读
+        size_ = pending_.valid() ? pending_.get() : 0;
+        pos_ = 0;
+        swap(current_, next_);
+        if (size_ == current_.size()) {
+            prefetch();
+        }
+    }
+
+    FILE *file_ = nullptr;
+    vector<T> current_, next_;
+    size_t pos_ = 0, size_ = 0;
+    future<size_t> pending_;
+};
+
+template <typename T>
+class ExternalRunWriter {
+public:
+    ExternalRunWriter(const string &path, size_t blockSize) : buffer_(blockSize), writing_(blockSize) {
+        file_ = fopen(path.c_str(), "wb");
+        failed_ = !file_;
+    }
+    ~ExternalRunWriter() {
+        close();
+    }
+    void push(const T &v) {
+        buffer_[count_++] = v;
+        if (count_ == buffer_.size()) {
+            flush();
+        }
+    }
+    //写完并关闭文件，返回是否全部写成功
+    bool close() {
+        if (file_) {
+            flush();
+            wait();
+            failed_ |= fclose(file_) != 0;
+            file_ = nullptr;
+        }
+        return !failed_;
+    }
+private:
+    void wait() {
+        if (pending_.valid()) {
+            failed_ |= !pending_.get();
+        }
+    }
+    void flush() {
+        wait();
+        if (count_ == 0 || failed_) {
+            count_ = 0;
+            return;
+        }
+        swap(buffer_, writing_);
+        size_t count = count_;
+        count_ = 0;
+        pending_ = async(launch::async, [this, count]{return fwrite(writing_.data(), sizeof(T), count, file_) == count;});
+    }
+
+    FILE *file_ = nullptr;
+    vector<T> buffer_, writing_;
+    size_t count_ = 0;
+    bool failed_ = false;
+    future<bool> pending_;
+};
+
+//把runs[begin, end)归并到outputPath
+template <typename T>
+bool external_merge(const vector<string> &runs, size_t begin, size_t end, const string &outputPath, size_t memoryBytes) {
+    int k = end - begin;
+    //每个run和输出各两块，k不超过external_sort_fan_in时每块至少EXTERNAL_SORT_MIN_BLOCK_BYTES
+    size_t blockSize = memoryBytes / (2 * (k + 1)) / sizeof(T);
+    vector<unique_ptr<ExternalRunReader<T>>> readers;
+    for (size_t i = begin;i < end;i++) {
+        readers.emplace_back(new ExternalRunReader<T>(runs[i], blockSize));
+        if (!readers.back()->ok()) {
+            return false;
+        }
+    }
+    ExternalRunWriter<T> writer(outputPath, blockSize);
+    //每个run当前的数缓存在连续数组里，比较时不用访问reader
+    //读完的run的key设成最大值，只有相等时才需要看done，读完的排在后面
+    vector<T> keys(k);
+    vector<char> done(k);
+    auto load = [&](int i) {
+        done[i] = readers[i]->empty();
+        keys[i] = done[i] ? numeric_limits<T>::max() : readers[i]->front();
+    };
+    for (int i = 0;i < k;i++) {
+        load(i);
+    }
+    auto less = [&](int a, int b) {
+        return keys[a] < keys[b] || (keys[a] == keys[b] && done[a] < done[b]);
+    };
+    //败者树: 叶子i在节点k + i，内部节点1到k - 1存败者，tree[0]存最后的胜者
+    vector<int> tree(k);
+    function<int(int)> build = [&](int node) {
+        if (node >= k) {
+            return node - k;
+        }
+        int l = build(2 * node), r = build(2 * node + 1);
+        if (less(r, l)) {
+            tree[node] = l;
+            return r;
+        }
+        tree[node] = r;
+        return l;
+    };
+    tree[0] = k == 1 ? 0 : build(1);
+    while(!done[tree[0]]) {
+        int winner = tree[0];
+        writer.push(keys[winner]);
+        readers[winner]->pop();
+        load(winner);
+        //只和从叶子到根路径上的败者比较
+        for (int node = (winner + k) / 2;node >= 1;node /= 2) {
+            if (less(tree[node], winner)) {
+                swap(tree[node], winner);
+            }
+        }
+        tree[0] = winner;
+    }
+    for (auto &reader : readers) {
+        if (!reader->ok()) {
+            return false;
+        }
+    }
+    return writer.close();
+}
+
+//tmpDir放中间的run文件，结束后删掉
+template <typename T>
+bool external_sort(const string &inputPath, const string &outputPath, const string &tmpDir, size_t memoryBytes) {
+    size_t fanIn = external_sort_fan_in(memoryBytes);
+    if (fanIn < 2) {
+        return false;
+    }
+    vector<string> runs;
+    auto cleanup = [&](bool ok) {
+        for (auto &run : runs) {
+            remove(run.c_str());
+        }
+        return ok;
+    };
+    auto newRunPath = [&] {
+        static atomic<int> runId{0};
+        return tmpDir + "/run_" + to_string(runId++);
+    };
+    FILE *in = fopen(inputPath.c_str(), "rb");
+    if (!in) {
+        return false;
+    }
+    size_t chunkSize = max<size_t>(memoryBytes / 2 / sizeof(T), 1);
+    vector<T> chunk(chunkSize);
+    while(true) {
+        size_t n = fread(chunk.data(), sizeof(T), chunkSize, in);
+        if (n == 0) {
+            break;
+        }
+        //只有最后一段会不满
+        chunk.resize(n);
+        fast_sort(chunk);
+        runs.push_back(newRunPath());
+        FILE *out = fopen(runs.back().c_str(), "wb");
+        bool ok = out && fwrite(chunk.data(), sizeof(T), n, out) == n;
+        if (out) {
+            ok &= fclose(out) == 0;
+        }
+        if (!ok) {
+            fclose(in);
+            return cleanup(false);
+        }
+    }
+    bool readOk = !ferror(in);
+    fclose(in);
+    vector<T>().swap(chunk);
+    if (!readOk) {
+        return cleanup(false);
+    }
+    if (runs.empty()) {
+        FILE *out = fopen(outputPath.c_str(), "wb");
+        return out && fclose(out) == 0;
+    }
+    while(runs.size() > fanIn) {
+        vector<string> merged;
+        for (size_t i = 0;i < runs.size();i += fanIn) {
+            size_t end = min(runs.size(), i + fanIn);
+            merged.push_back(newRunPath());
+            bool ok = external_merge<T>(runs, i, end, merged.back(), memoryBytes);
+            for (size_t j = i;j < end;j++) {
+                remove(runs[j].c_str());
+            }
+            if (!ok) {
+                //没归并的run和已经生成的新run都要删
+                runs.erase(runs.begin(), runs.begin() + end);
+                runs.insert(runs.end(), merged.begin(), merged.end());
+                return cleanup(false);
+            }
+        }
+        runs.swap(merged);
+    }
+    return cleanup(external_merge<T>(runs, 0, runs.size(), outputPath, memoryBytes));
+}
+//external sort end
+
+//tim sort
+//稳定的自适应归并排序，适合大部分有序、少量乱序的数据
+//1 从左往右找自然的run，严格降序的run翻转成升序，太短的run用二分插入排序补到minRun
+//2 run压栈，栈顶几个run的长度不满足类似斐波那契的约束时合并，保证合并是平衡的
+//3 合并前先用二分跳过两边已经在最终位置的数，只把短的一边拷到scratch buffer
+//4 合并时一边连续赢了minGallop次就进入galloping模式，用指数搜索一次搬一整段
+//完全有序时只有一个run，O(n)
+#define TIM_SORT_MIN_MERGE 32
+#define TIM_SORT_MIN_GALLOP 7
+
+template <typename T, typename Compare = std::less<T>>
+class TimSorter {
+public:
+    explicit TimSorter(Compare comp = Compare()) : comp_(comp) {}
+
+    //scratch buffer在多次排序之间复用
+    void sort(T *begin, T *end) {
+        int n = end - begin;
+        if (n < 2) {
+            return;
+        }
+        minGallop_ = TIM_SORT_MIN_GALLOP;
+        runs_.clear();
+        int minRun = min_run(n);
+        for (int lo = 0;lo < n;) {
+            int len = count_run(begin + lo, n - lo);
+            if (len < minRun) {
+                int forced = min(minRun, n - lo);
+                binary_insertion_sort(begin + lo, forced, len);
+                len = forced;
+            }
+            runs_.push_back({begin + lo, len});
+            merge_collapse();
+            lo += len;
+        }
+        while(runs_.size() > 1) {
+            int i = runs_.size() - 2;
+            if (i > 0 && runs_[i - 1].len < runs_[i + 1].len) {
+                i--;
+            }
+            merge_at(i);
+        }
+    }
+
+private:
+    struct Run {
+        T *base;
+        int len;
+    };
+
+    //n小于TIM_SORT_MIN_MERGE时直接插入排序，否则取n的高6位，有余数再加1
+    //这样n / minRun接近但不超过2的幂，最后几次合并比较平衡
+    static int min_run(int n) {
+        int r = 0;
+        while(n >= TIM_SORT_MIN_MERGE) {
+            r |= n & 1;
+            n >>= 1;
+        }
+        return n + r;
+    }
+
+    //返回从a开始的run长度，严格降序的翻转，非严格降序翻转后会破坏稳定性
+    int count_run(T *a, int n) {
+        if (n == 1) {
+            return 1;
+        }
+        int len = 2;
+        if (comp_(a[1], a[0])) {
+            while(len < n && comp_(a[len], a[len - 1])) len++;
+            reverse(a, a + len);
+        }else {
+            while(len < n && !comp_(a[len], a[len - 1])) len++;
+        }
+        return len;
+    }
+
+    //[0, sorted)已经有序
+    void binary_insertion_sort(T *a, int n, int sorted) {
+        for (int i = sorted;i < n;i++) {
+            T pivot = std::move(a[i]);
+            T *pos = upper_bound(a, a + i, pivot, comp_);
+            move_backward(pos, a + i, a + i + 1);
+            *pos = std::move(pivot);
+        }
+    }
+
+    //a中满足条件的数是一个前缀，返回前缀长度
+    //Upper为false时条件是x < key，为true时是x <= key
+    //从左端或右端按1,3,7,15...的间隔试探，找到区间后再二分
+    template <bool Upper>
+    int gallop(const T &key, const T *a, int n, bool fromRight) {
+        auto pred = [&](const T &x) {return Upper ? !comp_(key, x) : comp_(x, key);};
+        int lo, hi;
+        if (!fromRight) {
+            if (!pred(a[0])) return 0;
+            int last = 0, ofs = 1;
+            while(ofs < n && pred(a[ofs])) {
+                last = ofs;
+                ofs = ofs * 2 + 1;
+            }
+            lo = last + 1;
+            hi = min(ofs, n);
+        }else {
+            if (pred(a[n - 1])) return n;
+            int last = 0, ofs = 1;
+            while(ofs < n && !pred(a[n - 1 - ofs])) {
+                last = ofs;
+                ofs = ofs * 2 + 1;
+            }
+            lo = max(0, n - ofs);
+            hi = n - 1 - last;
+        }
+        return partition_point(a + lo, a + hi, pred) - a;
+    }
+
+    //栈顶的三个run满足len[i - 2] > len[i - 1] + len[i]且len[i - 1] > len[i]
+    //同时检查第四个run，只检查三个时约束会被破坏
+    void merge_collapse() {
+        while(runs_.size() > 1) {
+            int n = runs_.size() - 2;
+            if ((n > 0 && runs_[n - 1].len <= runs_[n].len + runs_[n + 1].len) ||
+                (n > 1 && runs_[n - 2].len <= runs_[n - 1].len + runs_[n].len)) {
+                if (runs_[n - 1].len < runs_[n + 1].len) {
+                    n--;
+                }
+            }else if (runs_[n].len > runs_[n + 1].len) {
+                break;
+            }
+            merge_at(n);
+        }
+    }
+
+    //合并runs_[i]和runs_[i + 1]
+    void merge_at(int i) {
+        T *base1 = runs_[i].base, *base2 = runs_[i + 1].base;
+        int len1 = runs_[i].len, len2 = runs_[i + 1].len;
+        runs_[i].len = len1 + len2;
+        runs_.erase(runs_.begin() + i + 1);
+        //run1里<=run2[0]的前缀和run2里>=run1最后一个数的后缀都已经在最终位置
+        int k = gallop<true>(*base2, base1, len1, false);
+        base1 += k;
+        len1 -= k;
+        if (len1 == 0) {
+            return;
+        }
+        len2 = gallop<false>(base1[len1 - 1], base2, len2, true);
+        if (len2 == 0) {
+            return;
+        }
+        if (len1 <= len2) {
+            merge_lo(base1, len1, base2, len2);
+        }else {
+            merge_hi(base1, len1, base2, len2);
+        }
+    }
+
+    T *reserve(int n) {
+        if ((int)buffer_.size() < n) {
+            buffer_.resize(max<size_t>(n, buffer_.size() * 2));
+        }
+        return buffer_.data();
+    }
+
+    //run1拷到buffer，从左往右合并
+    //调用前run1[0] > run2[0]，run1最后一个数 > run2所有数，所以run1不会先用完
+    void merge_lo(T *base1, int len1, T *base2, int len2) {
+        T *tmp = reserve(len1);
+        std::move(base1, base1 + len1, tmp);
+        T *cursor1 = tmp, *cursor2 = base2, *dest = base1;
+        *dest++ = std::move(*cursor2++);
+        len2--;
+        int minGallop = minGallop_;
+        while(len1 > 1 && len2 > 0) {
+            //一个一个比较，直到一边连续赢minGallop次
+            int count1 = 0, count2 = 0;
+            while(len1 > 1 && len2 > 0 && max(count1, count2) < minGallop) {
+                if (comp_(*cursor2, *cursor1)) {
+                    *dest++ = std::move(*cursor2++);
+                    len2--;
+                    count2++;
+                    count1 = 0;
+                }else {
+                    *dest++ = std::move(*cursor1++);
+                    len1--;
+                    count1++;
+                    count2 = 0;
+                }
+            }
+            if (len1 <= 1 || len2 == 0) {
+                break;
+            }
+            //galloping，每轮两边各找一段一次搬完，搬得少了就退回去
+            minGallop++;
+            while(len1 > 1 && len2 > 0) {
+                if (minGallop > 1) minGallop--;
+                count1 = gallop<true>(*cursor2, cursor1, len1, false);
+                dest = std::move(cursor1, cursor1 + count1, dest);
+                cursor1 += count1;
+                len1 -= count1;
+                if (len1 <= 1) break;
+                *dest++ = std::move(*cursor2++);
+                if (--len2 == 0) break;
+                count2 = gallop<false>(*cursor1, cursor2, len2, false);
+                dest = std::move(cursor2, cursor2 + count2, dest);
+                cursor2 += count2;
+                len2 -= count2;
+                if (len2 == 0) break;
+                *dest++ = std::move(*cursor1++);
+                if (--len1 == 1) break;
+                if (count1 < TIM_SORT_MIN_GALLOP && count2 < TIM_SORT_MIN_GALLOP) {
+                    minGallop++;
+                    break;
+                }
+            }
+        }
+        minGallop_ = max(1, minGallop);
+        if (len1 == 1) {
+            dest = std::move(cursor2, cursor2 + len2, dest);
+            *dest = std::move(*cursor1);
+        }else {
+            std::move(cursor1, cursor1 + len1, dest);
+        }
+    }
+
+    //run2拷到buffer，从右往左合并，和merge_lo对称，run2不会先用完
+    void merge_hi(T *base1, int len1, T *base2, int len2) {
+        T *tmp = reserve(len2);
+        std::move(base2, base2 + len2, tmp);
+        //都指向还没处理的部分的末尾后一位
+        T *cursor1 = base1 + len1, *cursor2 = tmp + len2, *dest = base2 + len2;
+        *--dest = std::move(*--cursor1);
+        len1--;
+        int minGallop = minGallop_;
+        while(len1 > 0 && len2 > 1) {
+            int count1 = 0, count2 = 0;
+            while(len1 > 0 && len2 > 1 && max(count1, count2) < minGallop) {
+                if (comp_(cursor2[-1], cursor1[-1])) {
+                    *--dest = std::move(*--cursor1);
+                    len1--;
+                    count1++;
+                    count2 = 0;
+                }else {
+                    *--dest = std::move(*--cursor2);
+                    len2--;
+                    count2++;
+                    count1 = 0;
+                }
+            }
+            if (len1 == 0 || len2 <= 1) {
+                break;
+            }
+            minGallop++;
+            while(len1 > 0 && len2 > 1) {
+                if (minGallop > 1) minGallop--;
+                //run1里>cursor2[-1]的后缀
+                count1 = len1 - gallop<true>(cursor2[-1], cursor1 - len1, len1, true);
+                dest = move_backward(cursor1 - count1, cursor1, dest);
+                cursor1 -= count1;
+                len1 -= count1;
+                if (len1 == 0) break;
+                *--dest = std::move(*--cursor2);
+                if (--len2 == 1) break;
+                //run2里>=cursor1[-1]的后缀
+                count2 = len2 - gallop<false>(cursor1[-1], cursor2 - len2, len2, true);
+                dest = move_backward(cursor2 - count2, cursor2, dest);
+                cursor2 -= count2;
+                len2 -= count2;
+                if (len2 <= 1) break;
+                *--dest = std::move(*--cursor1);
+                if (--len1 == 0) break;
+                if (count1 < TIM_SORT_MIN_GALLOP && count2 < TIM_SORT_MIN_GALLOP) {
+                    minGallop++;
+                    break;
+                }
+            }
+        }
+        minGallop_ = max(1, minGallop);
+        if (len2 == 1) {
+            dest = move_backward(cursor1 - len1, cursor1, dest);
+            *--dest = std::move(cursor2[-1]);
+        }else {
+            move_backward(cursor2 - len2, cursor2, dest);
+        }
+    }
+
+    Compare comp_;
+    vector<T> buffer_;
+    vector<Run> runs_;
+    int minGallop_ = TIM_SORT_MIN_GALLOP;
+};
+
+template <typename T, typename Compare = std::less<T>>
+void tim_sort(vector<T> &nums, Compare comp = Compare()) {
+    TimSorter<T, Compare> sorter(comp);
+    sorter.sort(nums.data(), nums.data() + nums.size());
+}
+//tim sort end
+
+//argsort
+//返回下标的排列，keys[perm[0]] <= keys[perm[1]] <= ...，key相同时下标小的在前，和stable_sort的结果一致
+//下标用uint32_t，最多2^32 - 1个key，再多时抛length_error，不会悄悄截断
+//宽的记录排序时不动，排完用apply_permutation一次重排所有列
+//1 整数key且数量够多时，把(key, 下标)打包成小结构做LSD radix，LSD是稳定的，下标的顺序自然保持
+//2 其它key用pdq排下标，下标作为第二关键字
+template <typename K>
+vector<uint32_t> argsort(const vector<K> &keys) {
+    if (keys.size() > UINT32_MAX) {
+        throw length_error("argsort: more than 2^32 - 1 keys");
+    }
+    uint32_t n = keys.size();
+    vector<uint32_t> perm(n);
+    if constexpr (is_integral_v<K> && !is_same_v<K, bool>) {
+        if (n >= RADIX_SORT_THRESHOLD) {
+            struct Item {
+                K key;
+                uint32_t index;
+            };
+            vector<Item> items(n);
+            for (uint32_t i = 0;i < n;i++) {
+                items[i] = {keys[i], i};
+            }
+            lsd_radix_sort_by_key(items, [](const Item &item){return item.key;});
+            for (uint32_t i = 0;i < n;i++) {
+                perm[i] = items[i].index;
+            }
+            return perm;
+        }
+    }
+    iota(perm.begin(), perm.end(), 0);
+    pdq_sort(perm.begin(), perm.end(), [&](uint32_t a, uint32_t b) {
+        if (keys[a] < keys[b]) return true;
+        if (keys[b] < keys[a]) return false;
+        return a < b;
+    });
+    return perm;
+}
+
+//按perm重排若干列，结束后columns[i] = 原来的columns[perm[i]]
+//每次取一小块perm，依次gather每一列，这块perm一直在L1里，每一列的写入都是顺序的
+//每个元素只被读一次，可以直接move，string这类列不会拷贝
+#define APPLY_PERMUTATION_BLOCK 4096
+template <typename T>
+void apply_permutation_block(const uint32_t *perm, size_t begin, size_t end, vector<T> &column, vector<T> &output) {
+    for (size_t i = begin;i < end;i++) {
+        output[i] = std::move(column[perm[i]]);
+    }
+}
+
+template <typename... Columns>
+void apply_permutation(const vector<uint32_t> &perm, vector<Columns> &...columns) {
+    size_t n = perm.size();
+    tuple<vector<Columns>...> outputs{vector<Columns>(n)...};
+    std::apply([&](auto &...output) {
+        for (size_t begin = 0;begin < n;begin += APPLY_PERMUTATION_BLOCK) {
+            size_t end = min(n, begin + APPLY_PERMUTATION_BLOCK);
+            (apply_permutation_block(perm.data(), begin, end, columns, output), ...);
+        }
+        (columns.swap(output), ...);
+    }, outputs);
+}
+//argsort end
+
+//1000w数据，38MB
+void topKTest(int k) {
+    cout << __FUNCTION__ << " " << LOGV(k) << endl;
+    int testCount = 10000000;
+    vector<int> origin(testCount, 0);
+    for (int i = 0;i < testCount;i++) {
+        origin[i] = rand() % INT_MAX;
+    }
+    auto sorted = origin;
+    sort(sorted.begin(), sorted.end(), greater<int>());
+    vector<int> expect(sorted.begin(), sorted.begin() + k);
+    auto check = [&](const string &name, vector<int> results) {
+        sort(results.begin(), results.end(), greater<int>());
+        if (results != expect) {
+            cout << name << " failed" << endl;
+        }
+    };
+    vector<int> nums;
+    vector<int> results;
+    nums = origin;
+    {
+        Timer t("top_k unsorted");
+        results = top_k(nums, k);
+    }
+    check("top_k unsorted", results);
+    nums = origin;
+    {
+        Timer t("top_k sorted");
+        results = top_k(nums, k, true);
+    }
+    check("top_k sorted", results);
+    if (!is_sorted(results.begin(), results.end(), greater<int>())) {
+        cout << "top_k sorted not sorted" << endl;
+    }
+    nums = origin;
+    {
+        Timer t("nth_element");
+        nth_element(nums.begin(), nums.begin() + (testCount - k), nums.end());
+        results.assign(nums.begin() + (testCount - k), nums.end());
+    }
+    check("nth_element", results);
+    nums = origin;
+    {
+        Timer t("partial_sort");
+        partial_sort(nums.begin(), nums.begin() + k, nums.end(), greater<int>());
+        results.assign(nums.begin(), nums.begin() + k);
+    }
+    check("partial_sort", results);
+}
+
+//1000w数据，38MB，线程数从1翻倍到全部核数
+void parallelScalingTest(int testCount) {
+    cout << __FUNCTION__ << " " << LOGV(testCount) << endl;
+    vector<int> origin(testCount, 0);
+    for (int i = 0;i < testCount;i++) {
+        origin[i] = rand() % INT_MAX;
+    }
+    auto sorted = origin;
+    sort(sorted.begin(), sorted.end());
+    vector<int> nums;
+    nums = origin;
+    {
+        Timer t("std::sort");
+        sort(nums.begin(), nums.end());
+    }
+#ifdef QUICK_SORT_WITH_PSTL
+    nums = origin;
+    {
+        Timer t("std::sort par");
+        sort(std::execution::par, nums.begin(), nums.end());
+    }
+#endif
+    //核数不到4时也跑到4个线程，多出来的线程只能分时，这时只检查结果，耗时看的是多一遍分桶的开销
+    int cores = max(1u, thread::hardware_concurrency());
+    int maxThreads = max(cores, 4);
+    cout << LOGV(cores) << endl;
+    for (int threads = 1;;threads = min(threads * 2, maxThreads)) {
+        nums = origin;
+        {
+            Timer t("parallel_sort threads = " + to_string(threads) + (threads > cores ? " (oversubscribed)" : ""));
+            parallel_sort(nums, threads);
+        }
+        if (nums != sorted) {
+            cout << "parallel_sort failed" << endl;
+        }
+        if (threads == maxThreads) {
+            break;
+        }
+    }
+}
+
+//通用接口: 迭代器+比较函数，只能move的记录，按key缓存排序
+struct SortRecord {
+    int64_t id;
+    string name;
+    unique_ptr<int> payload;
+    //模拟开销大的访问器
+    string upperName() const {
+        string s = name;
+        for (auto &c : s) c = toupper(c);
+        return s;
+    }
+};
+
+void genericSortTest(int testCount) {
+    cout << __FUNCTION__ << " " << LOGV(testCount) << endl;
+    //记录只能move，每次用同一组随机数重新构造
+    vector<int> values(testCount);
+    for (auto &v : values) {
+        v = rand() % INT_MAX;
+    }
+    auto makeRecords = [&] {
+        vector<SortRecord> records;
+        records.reserve(testCount);
+        for (auto v : values) {
+            records.push_back({v, "name" + to_string(v % 100000), make_unique<int>(v)});
+        }
+        return records;
+    };
+    auto byId = [](const SortRecord &a, const SortRecord &b) {return a.id < b.id;};
+    auto payloadOk = [](const vector<SortRecord> &records) {
+        for (auto &r : records) {
+            if (!r.payload || *r.payload != r.id) return false;
+        }
+        return true;
+    };
+    {
+        auto records = makeRecords();
+        {
+            Timer t("pdq_sort records by id");
+            pdq_sort(records.begin(), records.end(), byId);
+        }
+        if (!is_sorted(records.begin(), records.end(), byId) || !payloadOk(records)) {
+            cout << "pdq_sort records failed" << endl;
+        }
+    }
+    {
+        auto records = makeRecords();
+        Timer t("std::sort records by id");
+        sort(records.begin(), records.end(), byId);
+    }
+    {
+        auto nums = getRandomVector();
+        {
+            Timer t("pdq_sort greater");
+            pdq_sort(nums.begin(), nums.end(), greater<int>());
+        }
+        if (!is_sorted(nums.begin(), nums.end(), greater<int>())) {
+            cout << "pdq_sort greater failed" << endl;
+        }
+    }
+    auto byUpperName = [](const SortRecord &a, const SortRecord &b) {return a.upperName() < b.upperName();};
+    vector<SortRecord> expect;
+    {
+        auto records = makeRecords();
+        Timer t("std::stable_sort accessor in compare");
+        stable_sort(records.begin(), records.end(), byUpperName);
+        expect = move(records);
+    }
+    {
+        auto records = makeRecords();
+        Timer t("pdq_sort accessor in compare");
+        pdq_sort(records.begin(), records.end(), byUpperName);
+    }
+    {
+        auto records = makeRecords();
+        {
+            Timer t("pdq_sort_by_key cached key");
+            pdq_sort_by_key(records.begin(), records.end(), [](const SortRecord &r) {return r.upperName();});
+        }
+        bool same = payloadOk(records);
+        for (int i = 0;same && i < testCount;i++) {
+            same = records[i].id == expect[i].id;
+        }
+        if (!same) {
+            cout << "pdq_sort_by_key failed" << endl;
+        }
+    }
+}
+
+//把100w个数切成size大小的小段分别排序，对比排序网络和标量插入排序
+void smallSortTest(int size) {
+    cout << __FUNCTION__ << " " << LOGV(size) << endl;
+    auto origin = getRandomVector();
+    int testCount = origin.size() / size * size;
+    auto check = [&](const string &name, const vector<int> &nums) {
+        for (int i = 0;i < testCount;i += size) {
+            if (!is_sorted(nums.begin() + i, nums.begin() + i + size)) {
+                cout << name << " failed" << endl;
+                return;
+            }
+        }
+    };
+    auto nums = origin;
+    {
+        Timer t("simd network");
+        for (int i = 0;i < testCount;i += size) {
+            simd_sort_small(nums.data() + i, size);
+        }
+    }
+    check("simd network", nums);
+    nums = origin;
+    {
+        Timer t("scalar insertion");
+        for (int i = 0;i < testCount;i += size) {
+            pdq_insertion_sort(nums.data() + i, nums.data() + i + size, std::less<int>());
+        }
+    }
+    check("scalar insertion", nums);
+    nums = origin;
+    {
+        Timer t("std::sort");
+        for (int i = 0;i < testCount;i += size) {
+            sort(nums.begin() + i, nums.begin() + i + size);
+        }
+    }
+    check("std::sort", nums);
+}
+
+void partitionTest() {
+    cout << __FUNCTION__ << endl;
+    auto origin = getRandomVector();
+    int pivot = INT_MAX / 2;
+    auto nums = origin;
+    int *mid = nullptr;
+    {
+        Timer t("simd partition");
+        mid = simd_partition(nums.data(), nums.data() + nums.size(), pivot);
+    }
+    if (!all_of(nums.data(), mid, [&](int v){return v <= pivot;}) ||
+        !all_of(mid, nums.data() + nums.size(), [&](int v){return v > pivot;})) {
+        cout << "simd partition failed" << endl;
+    }
+    nums = origin;
+    {
+        Timer t("scalar partition");
+        scalar_partition(nums.data(), nums.data() + nums.size(), pivot);
+    }
+}
+
+//生成testCount个随机数的文件，限制memoryBytes内存做外部排序，再顺序读一遍检查
+//数据和中间文件都放在临时目录，结束后删掉
+void externalSortTest(int64_t testCount, size_t memoryBytes, bool expectOk = true) {
+    cout << __FUNCTION__ << " " << LOGV(testCount) << LOGV(memoryBytes) << endl;
+    string pattern = (filesystem::temp_directory_path() / "quick_sort_external_XXXXXX").string();
+    if (!mkdtemp(pattern.data())) {
+        cout << "mkdtemp failed" << endl;
+        return;
+    }
+    string tmpDir = pattern;
+    string inputPath = tmpDir + "/input", outputPath = tmpDir + "/output";
+    const size_t blockSize = 1 << 20;
+    //检查时比较个数和和，元素不会丢也不会多
+    uint64_t inputSum = 0;
+    {
+        Timer t("generate");
+        mt19937 rng(testCount);
+        ExternalRunWriter<int> writer(inputPath, blockSize);
+        for (int64_t i = 0;i < testCount;i++) {
+            int v = rng();
+            inputSum += v;
+            writer.push(v);
+        }
+        if (!writer.close()) {
+            cout << "generate failed" << endl;
+            filesystem::remove_all(tmpDir);
+            return;
+        }
+    }
+    bool ok;
+    {
+        Timer t("external_sort");
+        ok = external_sort<int>(inputPath, outputPath, tmpDir, memoryBytes);
+    }
+    if (!expectOk) {
+        if (ok) {
+            cout << "external_sort should fail" << endl;
+        }
+        filesystem::remove_all(tmpDir);
+        return;
+    }
+    if (ok) {
+        Timer t("check");
+        ExternalRunReader<int> reader(outputPath, blockSize);
+        int64_t count = 0;
+        uint64_t sum = 0;
+        int last = INT_MIN;
+        while(!reader.empty()) {
+            int v = reader.front();
+            reader.pop();
+            ok &= v >= last;
+            last = v;
+            sum += v;
+            count++;
+        }
+        ok &= reader.ok() && count == testCount && sum == inputSum;
+    }
+    if (!ok) {
+        cout << "external_sort failed" << endl;
+    }
+    filesystem::remove_all(tmpDir);
+}
+
+//按key排序(key, 原下标)，key只有几种取值，和stable_sort对比，检查相等key的顺序没变
+void stableSortTest() {
+    cout << __FUNCTION__ << endl;
+    using Item = pair<int, int>;
+    auto keyLess = [](const Item &a, const Item &b) {return a.first < b.first;};
+    vector<function<vector<int>()>> generators{
+        []{return getFewUniqueVector(4);}, getReverseVector, getOrganPipeVector,
+        []{return getNearlySortedVector(0.01);}};
+    for (int i = 0;i < (int)generators.size();i++) {
+        auto keys = generators[i]();
+        for (int n : {0, 1, 2, 31, 64, 1000, 100000, (int)keys.size()}) {
+            vector<Item> items(n);
+            for (int j = 0;j < n;j++) {
+                items[j] = {keys[j] % 1000, j};
+            }
+            auto expected = items;
+            stable_sort(expected.begin(), expected.end(), keyLess);
+            tim_sort(items, keyLess);
+            if (items != expected) {
+                cout << "tim_sort not stable, generator: " << i << " n: " << n << endl;
+            }
+        }
+    }
+}
+
+//列存的记录: id, name, score，再加一个宽的payload
+//对比argsort + apply_permutation和直接排整行
+struct ArgsortRow {
+    int64_t id;
+    string name;
+    double score;
+    array<char, 64> payload;
+};
+
+void argsortTest(int testCount) {
+    cout << __FUNCTION__ << " " << LOGV(testCount) << endl;
+    auto stablePerm = [](auto &keys) {
+        vector<uint32_t> perm(keys.size());
+        iota(perm.begin(), perm.end(), 0);
+        stable_sort(perm.begin(), perm.end(), [&](uint32_t a, uint32_t b){return keys[a] < keys[b];});
+        return perm;
+    };
+    vector<int64_t> ids(testCount);
+    vector<string> names(testCount);
+    vector<double> scores(testCount);
+    vector<ArgsortRow> rows(testCount);
+    for (int i = 0;i < testCount;i++) {
+        ids[i] = (int64_t)(rand() % 1000 - 500) * rand();
+        names[i] = "name" + to_string(rand() % 10000);
+        scores[i] = rand() / (double)RAND_MAX;
+        rows[i] = {ids[i], names[i], scores[i], {}};
+    }
+    //radix和pdq两条路径都要和stable_sort的排列一样
+    vector<uint32_t> perm;
+    {
+        Timer t("argsort int64 radix");
+        perm = argsort(ids);
+    }
+    if (perm != stablePerm(ids)) {
+        cout << "argsort int64 failed" << endl;
+    }
+    vector<int> fewUnique(ids.size());
+    for (int i = 0;i < testCount;i++) {
+        fewUnique[i] = ids[i] % 16;
+    }
+    if (argsort(fewUnique) != stablePerm(fewUnique)) {
+        cout << "argsort few unique failed" << endl;
+    }
+    {
+        Timer t("argsort string pdq");
+        perm = argsort(names);
+    }
+    if (perm != stablePerm(names)) {
+        cout << "argsort string failed" << endl;
+    }
+    {
+        Timer t("stable_sort index");
+        stablePerm(ids);
+    }
+    auto expectedIds = ids;
+    auto expectedNames = names;
+    {
+        Timer t("argsort + apply_permutation 3 columns");
+        perm = argsort(ids);
+        apply_permutation(perm, ids, names, scores);
+    }
+    for (int i = 0;i < testCount;i++) {
+        if (ids[i] != expectedIds[perm[i]] || names[i] != expectedNames[perm[i]]) {
+            cout << "apply_permutation failed" << endl;
+            break;
+        }
+    }
+    {
+        Timer t("std::sort rows");
+        sort(rows.begin(), rows.end(), [](const ArgsortRow &a, const ArgsortRow &b){return a.id < b.id;});
+    }
+}
+
+//benchmark
+//输入在计时外生成好，每轮计时前拷一份，先跑一轮热身，再重复多轮取中位数
+//每个数的纳秒数报告中位数和标准差，cache miss和branch miss报告每个数的中位数
+//硬件计数器用perf_event_open，只统计用户态，虚拟机或者没权限时打印-
+//n小时重复次数多，保证每组总的数据量差不多
+#define BENCHMARK_MIN_REPEAT 3
+#define BENCHMARK_MAX_REPEAT 101
+#define BENCHMARK_ELEMENTS_PER_GROUP 10000000LL
+
+class PerfCounters {
+public:
+    PerfCounters() {
+#ifdef __linux__
+        leader_ = open(PERF_COUNT_HW_CACHE_MISSES, -1);
+        if (leader_ >= 0) {
+            member_ = open(PERF_COUNT_HW_BRANCH_MISSES, leader_);
+        }
+#endif
+    }
+    ~PerfCounters() {
+#ifdef __linux__
+        if (member_ >= 0) close(member_);
+        if (leader_ >= 0) close(leader_);
+#endif
+    }
+    bool ok() const {return leader_ >= 0 && member_ >= 0;}
+    void start() {
+#ifdef __linux__
+        if (!ok()) return;
+        ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    }
+    //返回{cache miss, branch miss}
+    pair<uint64_t, uint64_t> stop() {
+#ifdef __linux__
+        if (!ok()) return {0, 0};
+        ioctl(leader_, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        //PERF_FORMAT_GROUP: 个数 + 每个计数器的值
+        uint64_t values[3] = {0, 0, 0};
+        if (read(leader_, values, sizeof(values)) != sizeof(values)) return {0, 0};
+        return {values[1], values[2]};
+#else
+        return {0, 0};
+#endif
+    }
+private:
+#ifdef __linux__
+    static int open(uint64_t config, int groupFd) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.disabled = groupFd == -1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        return syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0);
+    }
+#endif
+    int leader_ = -1, member_ = -1;
+};
+
+//benchmark用的各种分布，n可以到1亿，用mt19937比rand()快且范围是32位
+//sawtooth: 32段递增，few unique: 16种取值
+//zipf: 取值范围min(n, 1 << 20)，第k个取值的概率和1 / k成正比，取值打散，不按频率有序
+vector<int> getBenchmarkVector(const string &distribution, int64_t n) {
+    vector<int> nums(n);
+    mt19937 rng(n);
+    if (distribution == "random") {
+        for (auto &v : nums) v = rng() & INT_MAX;
+    }else if (distribution == "sorted") {
+        iota(nums.begin(), nums.end(), 0);
+    }else if (distribution == "reverse") {
+        for (int64_t i = 0;i < n;i++) nums[i] = n - i;
+    }else if (distribution == "sawtooth") {
+        int64_t period = n / 32 + 1;
+        for (int64_t i = 0;i < n;i++) nums[i] = i % period;
+    }else if (distribution == "few unique") {
+        for (auto &v : nums) v = rng() % 16;
+    }else if (distribution == "zipf") {
+        int universe = min<int64_t>(n, 1 << 20);
+        vector<double> cdf(universe);
+        double sum = 0;
+        for (int k = 0;k < universe;k++) {
+            sum += 1.0 / (k + 1);
+            cdf[k] = sum;
+        }
+        uniform_real_distribution<double> uniform(0, sum);
+        for (auto &v : nums) {
+            int k = lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin();
+            v = ((uint32_t)min(k, universe - 1) * 2654435761u) & INT_MAX;
+        }
+    }
+    return nums;
+}
+
+struct BenchmarkResult {
+    double medianNs;
+    double stddevNs;
+    double cacheMisses;
+    double branchMisses;
+};
+
+inline double benchmarkMedian(vector<double> v) {
+    nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+    return v[v.size() / 2];
+}
+
+//每轮先用prepare重置数据(不计时)，再计时run，结果都除以n
+BenchmarkResult benchmarkRun(int64_t n, const function<void()> &prepare, const function<void()> &run) {
+    int repeat = min<int64_t>(max<int64_t>(BENCHMARK_ELEMENTS_PER_GROUP / n, BENCHMARK_MIN_REPEAT), BENCHMARK_MAX_REPEAT);
+    PerfCounters counters;
+    prepare();
+    run();
+    vector<double> ns, cacheMisses, branchMisses;
+    for (int i = 0;i < repeat;i++) {
+        prepare();
+        counters.start();
+        auto begin = chrono::steady_clock::now();
+        run();
+        auto end = chrono::steady_clock::now();
+        auto [cache, branch] = counters.stop();
+        ns.push_back(chrono::duration<double, nano>(end - begin).count() / n);
+        cacheMisses.push_back((double)cache / n);
+        branchMisses.push_back((double)branch / n);
+    }
+    double mean = accumulate(ns.begin(), ns.end(), 0.0) / repeat;
+    double variance = 0;
+    for (double v : ns) variance += (v - mean) * (v - mean);
+    BenchmarkResult result;
+    result.medianNs = benchmarkMedian(ns);
+    result.stddevNs = sqrt(variance / max(1, repeat - 1));
+    result.cacheMisses = counters.ok() ? benchmarkMedian(cacheMisses) : -1;
+    result.branchMisses = counters.ok() ? benchmarkMedian(branchMisses) : -1;
+    return result;
+}
+
+void benchmarkPrint(const string &engine, const string &distribution, int64_t n, const BenchmarkResult &r) {
+    auto counter = [](double v) {
+        if (v < 0) return string("-");
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.3f", v);
+        return string(buf);
+    };
+    printf("%-12s %-11s %10ld %10.2f %8.2f %12s %12s\n", engine.c_str(), distribution.c_str(), (long)n,
+        r.medianNs, r.stddevNs, counter(r.cacheMisses).c_str(), counter(r.branchMisses).c_str());
+}
+
+//n从1000开始每次乘10到maxSize
+void benchmarkSuite(int64_t maxSize) {
+    cout << __FUNCTION__ << " " << LOGV(maxSize) << endl;
+    vector<pair<string, function<void(vector<int>&)>>> sorts{
+        {"std::sort", [](vector<int> &nums){sort(nums.begin(), nums.end());}},
+        {"pdq", [](vector<int> &nums){pdq_sort(nums);}},
+        {"intro", [](vector<int> &nums){intro_sort(nums);}},
+        {"tim", [](vector<int> &nums){tim_sort(nums);}},
+        {"lsd radix", [](vector<int> &nums){lsd_radix_sort(nums);}},
+        {"simd", [](vector<int> &nums){simd_quick_sort(nums);}}};
+    vector<pair<string, function<void(vector<int>&, int)>>> selects{
+        {"nth_element", [](vector<int> &nums, int k){nth_element(nums.begin(), nums.begin() + k, nums.end());}},
+        {"intro select", [](vector<int> &nums, int k){intro_select(nums, k);}},
+        {"mom select", [](vector<int> &nums, int k){median_of_medians_select(nums, k);}}};
+    vector<string> distributions{"random", "sorted", "reverse", "sawtooth", "few unique", "zipf"};
+    printf("%-12s %-11s %10s %10s %8s %12s %12s\n", "engine", "input", "n", "ns/elem", "stddev", "cache-miss/e", "branch-miss/e");
+    for (int64_t n = 1000;n <= maxSize;n *= 10) {
+        for (auto &distribution : distributions) {
+            auto origin = getBenchmarkVector(distribution, n);
+            auto sorted = origin;
+            sort(sorted.begin(), sorted.end());
+            vector<int> nums;
+            for (auto &[engine, func] : sorts) {
+                auto result = benchmarkRun(n, [&]{nums = origin;}, [&]{func(nums);});
+                benchmarkPrint(engine, distribution, n, result);
+                if (nums != sorted) {
+                    cout << engine << " failed" << endl;
+                }
+            }
+            int k = n / 2;
+            for (auto &[engine, func] : selects) {
+                auto result = benchmarkRun(n, [&]{nums = origin;}, [&]{func(nums, k);});
+                benchmarkPrint(engine, distribution, n, result);
+                if (nums[k] != sorted[k]) {
+                    cout << engine << " failed" << endl;
+                }
+            }
+        }
+    }
+}
+//benchmark end
+
+template <typename T>
+void testFunc(const string &name, vector<int> nums, const T& f) {
+    LDEBUG(LOGV(name), "------------------------------", "start");
+    print(nums);
+    f(nums);
+    print(nums);
+    LDEBUG(LOGV(name), "------------------------------", "end");
+}
+
+int main(int argc, char **argv) {
+    srand(time(0));
+    //--benchmark-size=N: benchmarkSuite从1000测到N，默认1000000，1e8大约要1.6GB内存
+    //--large-external: 跑2GB的外部排序
+    int64_t benchmarkSize = 1000000;
+    bool largeExternal = false;
+    for (int i = 1;i < argc;i++) {
+        string arg = argv[i];
+        if (arg.rfind("--benchmark-size=", 0) == 0) {
+            benchmarkSize = atoll(arg.c_str() + strlen("--benchmark-size="));
+        }else if (arg == "--large-external") {
+            largeExternal = true;
+        }
+    }
+
+    auto my_quick_sort = [&](vector<int> &nums){quick_sort(nums);};
+    auto my_random_quick_sort = [&](vector<int> &nums){random_quick_sort(nums);};
+    auto other_csdn_quick_sort = [&](vector<int> &nums){csdn_quick_sort(nums, 0, nums.size() - 1);};
+    auto other_lc_quick_sort = [&](vector<int> &nums){lc_quick_sort(nums, 0, nums.size() - 1);};
+    auto other_stackoverflow_quick_sort = [&](vector<int> &nums){stackoverflow_quick_sort(nums, 0, nums.size() - 1);};
+    auto my_intro_sort = [&](vector<int> &nums){intro_sort(nums);};
+    auto my_pdq_sort = [&](vector<int> &nums){pdq_sort(nums);};
+    auto my_three_way_sort = [&](vector<int> &nums){three_way_sort(nums);};
+    auto my_parallel_sort = [&](vector<int> &nums){parallel_sort(nums);};
+    auto my_lsd_radix_sort = [&](vector<int> &nums){lsd_radix_sort(nums);};
+    auto my_msd_radix_sort = [&](vector<int> &nums){msd_radix_sort(nums);};
+    auto my_fast_sort = [&](vector<int> &nums){fast_sort(nums);};
+    auto my_simd_quick_sort = [&](vector<int> &nums){simd_quick_sort(nums);};
+    auto my_tim_sort = [&](vector<int> &nums){tim_sort(nums);};
+    auto std_stable_sort = [&](vector<int> &nums){stable_sort(nums.begin(), nums.end());};
+    auto std_quick_sort = [&](vector<int> &nums){sort(nums.begin(), nums.end());};
+    //vector<int> nums{3,2,1,6,4,1,2,3};
+    //vector<int> nums{3,2,1,3,2,1,1,2,3};
+    vector<int> nums{1,2};
+    testFunc("my normal", nums, my_quick_sort);
+    testFunc("my random", nums, my_random_quick_sort);
+    testFunc("csdn", nums, other_csdn_quick_sort);
+    testFunc("lc", nums, other_csdn_quick_sort);
+    testFunc("stackoverflow", nums, other_stackoverflow_quick_sort);
+    testFunc("intro", nums, my_intro_sort);
+    testFunc("pdq", nums, my_pdq_sort);
+    testFunc("three way", nums, my_three_way_sort);
+    testFunc("lsd radix", nums, my_lsd_radix_sort);
+    testFunc("msd radix", nums, my_msd_radix_sort);
+    testFuncOk("my normal", my_quick_sort, std_quick_sort);
+    testFuncOk("my random", my_random_quick_sort, std_quick_sort);
+    testFuncOk("csdn", other_csdn_quick_sort, std_quick_sort);
+    testFuncOk("lc", other_lc_quick_sort, std_quick_sort);
+    testFuncOk("stackoverflow", other_stackoverflow_quick_sort, std_quick_sort);
+    testFuncOk("intro", my_intro_sort, std_quick_sort);
+    testFuncOk("pdq", my_pdq_sort, std_quick_sort);
+    testFuncOk("three way", my_three_way_sort, std_quick_sort);
+    testFuncOk("parallel", my_parallel_sort, std_quick_sort);
+    testFuncOk("lsd radix", my_lsd_radix_sort, std_quick_sort);
+    testFuncOk("msd radix", my_msd_radix_sort, std_quick_sort);
+    testFuncOk("fast", my_fast_sort, std_quick_sort);
+    testFuncOk("simd", my_simd_quick_sort, std_quick_sort);
+    testFuncOk("tim", my_tim_sort, std_quick_sort);
+    vector<pair<string, function<vector<int>()>>> patterns{
+        {"random", getRandomVector}, {"sorted", getOrderedVector}, {"reverse", getReverseVector},
+        {"organ pipe", getOrganPipeVector}, {"few unique", []{return getFewUniqueVector();}},
+        {"1% perturbed", []{return getNearlySortedVector(0.01);}}, {"5% perturbed", []{return getNearlySortedVector(0.05);}}};
+    for (auto &[patternName, generator] : patterns) {
+        patternTest("intro", patternName, generator, my_intro_sort);
+        patternTest("pdq", patternName, generator, my_pdq_sort);
+        patternTest("three way", patternName, generator, my_three_way_sort);
+        patternTest("parallel", patternName, generator, my_parallel_sort);
+        patternTest("lsd radix", patternName, generator, my_lsd_radix_sort);
+        patternTest("msd radix", patternName, generator, my_msd_radix_sort);
+        patternTest("simd", patternName, generator, my_simd_quick_sort);
+        patternTest("tim", patternName, generator, my_tim_sort);
+        patternTest("std stable", patternName, generator, std_stable_sort);
+        patternTest("std", patternName, generator, std_quick_sort);
+    }
+    parallelScalingTest(10000000);
+    genericSortTest(1000000);
+    for (int size : {8, 16, 32, 64}) {
+        smallSortTest(size);
+    }
+    partitionTest();
+    stableSortTest();
+    argsortTest(1000000);
+    benchmarkSuite(benchmarkSize);
+    //1MB内存一次只能归并7个run，32个run要归并两轮
+    externalSortTest(1 << 22, 1 << 20);
+    //内存放不下两个run的块时返回false
+    externalSortTest(1000, 8 << 10, false);
+    //2GB数据，256MB内存，16个run，要写大约6GB临时文件，只在加了--large-external时跑
+    if (largeExternal) {
+        externalSortTest(1LL << 29, 256 << 20);
+    }
+    auto my_three_way_select = [&](vector<int> &nums, int k){three_way_select(nums, k);};
+    auto std_nth_element = [&](vector<int> &nums, int k){nth_element(nums.begin(), nums.begin() + k, nums.end());};
+    auto my_quick_select = [&](vector<int> &nums, int k){quick_select(nums, k);};
+    auto my_random_quick_select = [&](vector<int> &nums, int k){random_quick_select(nums, k);};
+    auto my_simple_mom_select = [&](vector<int> &nums, int k){simple_median_of_medians_select(nums, k);};
+    auto my_mom_select = [&](vector<int> &nums, int k){median_of_medians_select(nums, k);};
+    auto my_intro_select = [&](vector<int> &nums, int k){intro_select(nums, k);};
+    selectTest("quick", "random", getRandomVector, my_quick_select);
+    selectTest("random quick", "random", getRandomVector, my_random_quick_select);
+    for (auto &[patternName, generator] : patterns) {
+        selectTest("simple median of medians", patternName, generator, my_simple_mom_select);
+        selectTest("median of medians", patternName, generator, my_mom_select);
+        selectTest("intro", patternName, generator, my_intro_select);
+        selectTest("std", patternName, generator, std_nth_element);
+    }
+    for (int k : {10, 1000, 100000}) {
+        topKTest(k);
+    }
+    for (int uniqueCount : {2, 16, 1024, INT_MAX}) {
+        string patternName = "unique " + to_string(uniqueCount);
+        auto generator = [=]{return getFewUniqueVector(uniqueCount);};
+        patternTest("pdq", patternName, generator, my_pdq_sort);
+        patternTest("three way", patternName, generator, my_three_way_sort);
+        patternTest("std", patternName, generator, std_quick_sort);
+        selectTest("three way", patternName, generator, my_three_way_select);
+        selectTest("std", patternName, generator, std_nth_element);
+    }
 }
@@ -2,9 +2,55 @@
 
 #define private public
 
-template <typename T, typename getValueFuncT, typename CmpT = std::less<decltype(declval<getValueFuncT>()(declval<T>()))>>
+//rangePop的代价模型
+//按层序只找要弹出的: 每弹出一个，补上来的元素最多下沉log_Arity(n)层，全量扫描: 每个元素判断一次，剩下的再建堆
+//扫描一个元素的代价以下沉一层为单位，按testTimePairRangePopPerformance的结果定
+//RangePopHeap全量扫描是顺序读写，100万个元素的二叉堆上弹出不到约1.8%时rangePopPruned才更快，扫描一个元素约等于下沉0.35层
+//KeyCachedRangePopHeap两种做法都只搬node，单独用KEY_CACHED_RANGE_POP_SCAN_COST
+//弹出的个数在堆里均匀抽RANGE_POP_SAMPLE_COUNT个位置估计，堆的每个位置恰好一个元素，均匀抽位置就是均匀抽元素
+#define RANGE_POP_SAMPLE_COUNT 64
+#define RANGE_POP_SCAN_COST 0.35
+#define KEY_CACHED_RANGE_POP_SCAN_COST 0.4
+
+//qualify(i)表示第i个位置的元素要弹出
+template <typename QualifyFuncT>
+int64_t estimateRangePopCount(int64_t n, const QualifyFuncT &qualify) {
+    if (n <= RANGE_POP_SAMPLE_COUNT) {
+        int64_t count = 0;
+        for (int64_t i = 0;i < n;i++) {
+            count += qualify(i);
+        }
+        return count;
+    }
+    int64_t stride = n / RANGE_POP_SAMPLE_COUNT;
+    int64_t offset = rand() % stride;
+    int64_t count = 0;
+    for (int64_t i = 0;i < RANGE_POP_SAMPLE_COUNT;i++) {
+        count += qualify(offset + i * stride);
+    }
+    //多算一个，一个都没抽中时也按n / RANGE_POP_SAMPLE_COUNT估计，不会因为估计成0而反复退回全量扫描
+    return (count + 1) * n / RANGE_POP_SAMPLE_COUNT;
+}
+
+//rangePopPruned找到多少个位置以内比全量扫描便宜: k * 层数 < n * scanCost
+inline int64_t rangePopPrunedBudget(int64_t n, int arity, double scanCost) {
+    double levels = max(1.0, log((double)n) / log((double)arity));
+    return max<int64_t>(RANGE_POP_SAMPLE_COUNT, n * scanCost / levels);
+}
+
+//k个元素追加到n个元素的堆后面: 逐个上浮最坏k * 层数，整体从下往上建堆是O(n + k)
+inline bool pushBulkPreferHeapify(int64_t n, int64_t k, int arity) {
+    double levels = max(1.0, log((double)(n + k)) / log((double)arity));
+    return k * levels > n + k;
+}
+
+//Arity叉堆，4叉或8叉时一个节点的孩子挨在一起，比较孩子时基本只碰一两个cache line，层数也只有二叉的1/2或1/3
+//上浮下沉都是循环，先把要放的元素拿出来留一个空位，沿路把父/子节点move进空位，最后再放回去，不用每层swap
+//key可以是任意能用CmpT比较的类型，比较直接用KeyT，getValueFunc返回引用时不会拷贝key
+template <typename T, typename getValueFuncT, typename CmpT = std::less<decay_t<decltype(declval<getValueFuncT>()(declval<T>()))>>, int Arity = 2>
 class RangePopHeap {
-    using KeyT = decltype(declval<getValueFuncT>()(declval<T>()));
+    static_assert(Arity >= 2, "arity must be at least 2");
+    using KeyT = decay_t<decltype(declval<getValueFuncT>()(declval<T>()))>;
 public:
     RangePopHeap(const getValueFuncT& func) : cmp_(CmpT()), getValueFunc_(func) {
     }
@@ -18,101 +64,750 @@ public:
     void push(const T& v) {
         insert(v);
     }
+    //先全部追加，批量大时整体建堆，小时只对新元素逐个上浮
+    template <typename IterT>
+    void pushBulk(IterT first, IterT last) {
+        int64_t n = vs_.size();
+        vs_.insert(vs_.end(), first, last);
+        int64_t k = vs_.size() - n;
+        if (pushBulkPreferHeapify(n, k, Arity)) {
+            makeHeap();
+            return;
+        }
+        for (int64_t i = n;i < n + k;i++) {
+            siftUpAt(i);
+        }
+    }
+    //右值的range直接move进堆，元素可以是只能move的类型
+    template <typename RangeT>
+    void pushBulk(RangeT &&range) {
+        if constexpr (is_rvalue_reference<RangeT&&>::value) {
+            pushBulk(make_move_iterator(std::begin(range)), make_move_iterator(std::end(range)));
+        }else {
+            pushBulk(std::begin(range), std::end(range));
+        }
+    }
+    //先估计要弹出多少个，明显比budget多时直接全量扫描，否则先试rangePopPruned，找到的超过budget再改成全量扫描
+    //抽样的分辨率只有n / RANGE_POP_SAMPLE_COUNT，抽中一两个时估计偏大很多，所以估计在budget两倍以内的都先试，失败也只多走budget个位置
     vector<T> rangePop(const KeyT& key) {
-        bool ok = false;
-        auto results = rangePopLittleData(key, vs_.size() / std::log2(vs_.size()), ok);
-        if (!ok) {
-            rangePopLargeData(key, results);
+        vector<T> results;
+        if (empty() || cmp_(getValue(0), key)) {
+            return results;
+        }
+        int64_t n = vs_.size();
+        int64_t estimated = estimateRangePopCount(n, [&](int64_t i) {return !cmp_(getValue(i), key);});
+        int64_t budget = rangePopPrunedBudget(n, Arity, RANGE_POP_SCAN_COST);
+        if (estimated < 2 * budget && rangePopPruned(key, results, budget)) {
+            return results;
         }
+        results.reserve(min(n, estimated));
+        rangePopLargeData(key, results);
         return results;
     }
+    //只看父节点要弹出的节点，按层序找出全部k个要弹出的位置，O(k)，结果不保证有序
+    //这些位置在堆顶连成一片，层序遍历时下标是递增的
+    //弹出后用末尾不弹出的元素填下标小于n - k的空位，再从下往上只heapify填过的位置
+    //找到的个数超过countLimit时什么都不改，返回false
+    bool rangePopPruned(const KeyT& key, vector<T>& results, int64_t countLimit = INT64_MAX) {
+        int64_t n = vs_.size();
+        if (n == 0 || cmp_(getValue(0), key)) {
+            return true;
+        }
+        auto &positions = prunedPositions_;
+        positions.clear();
+        positions.push_back(0);
+        for (size_t i = 0;i < positions.size();i++) {
+            if ((int64_t)positions.size() > countLimit) {
+                return false;
+            }
+            int64_t first = firstChild(positions[i]);
+            int64_t last = min(first + Arity, n);
+            for (int64_t child = first;child < last;child++) {
+                if (!cmp_(getValue(child), key)) {
+                    positions.push_back(child);
+                }
+            }
+        }
+        int64_t k = positions.size();
+        int64_t m = n - k;
+        for (auto position : positions) {
+            results.emplace_back(move(vs_[position]));
+        }
+        int64_t holeEnd = lower_bound(positions.begin(), positions.end(), m) - positions.begin();
+        int64_t tail = n - 1;
+        int64_t j = k - 1;
+        for (int64_t i = 0;i < holeEnd;i++) {
+            //跳过末尾本身就是空位的位置
+            while(j >= holeEnd && positions[j] == tail) {
+                tail--;
+                j--;
+            }
+            vs_[positions[i]] = move(vs_[tail--]);
+        }
+        vs_.erase(vs_.begin() + m, vs_.end());
+        for (int64_t i = holeEnd - 1;i >= 0;i--) {
+            heapify(positions[i]);
+        }
+        return true;
+    }
     void rangePopLargeData(const KeyT& key, vector<T>& results) {
-        vector<T> newVs;
-        newVs.reserve(vs_.capacity());
-        for (auto &v : vs_) {
-            if (cmp_(getValueFunc_(v), key)) {
-                newVs.emplace_back(move(v));
+        //留下的元素原地往前挪，不另外分配数组，元素只move不拷贝
+        size_t kept = 0;
+        for (size_t i = 0;i < vs_.size();i++) {
+            if (cmp_(getValue(i), key)) {
+                if (kept != i) {
+                    vs_[kept] = move(vs_[i]);
+                }
+                kept++;
                 continue;
             }
-            results.emplace_back(move(v));
+            results.emplace_back(move(vs_[i]));
         }
-        makeHeap(newVs);
+        vs_.erase(vs_.begin() + kept, vs_.end());
+        makeHeap();
     }
     //smallHeap, range pop value, util value > key
+    //ok表示所有要弹出的都弹出了，countLimit用完时为false
     vector<T> rangePopLittleData(const KeyT& key, int64_t countLimit, bool &ok) {
         ok = false;
         vector<T> results;
-        results.reserve(vs_.capacity());
+        results.reserve(min<int64_t>(countLimit, vs_.size()));
         while(!empty()) {
             auto &v = top();
-            if (!countLimit--) {
-                break;
-            }
             if (cmp_(getValueFunc_(v), key)) {
                 ok = true;
                 break;
             }
+            if (!countLimit--) {
+                break;
+            }
             results.emplace_back(move(v));
             pop();
         }
+        ok |= empty();
         return results;
     }
     T& top() {
         return vs_[0];
     }
+    //末尾元素基本都是最"小"的，放到堆顶再下沉几乎一定沉到底
+    //所以空位直接沿着最大的孩子沉到叶子，不和末尾元素比较，再把末尾元素从叶子上浮，和std::pop_heap一样
     void pop() {
-        swap(vs_[0], vs_[vs_.size() - 1]);
+        int64_t size = vs_.size() - 1;
+        if (size == 0) {
+            vs_.pop_back();
+            return;
+        }
+        T v = move(vs_.back());
         vs_.pop_back();
-        heapify(0);
+        int64_t index = 0;
+        while(true) {
+            int64_t first = firstChild(index);
+            if (first >= size) {
+                break;
+            }
+            int64_t largestIndex = largestChild(first, min(first + Arity, size));
+            vs_[index] = move(vs_[largestIndex]);
+            index = largestIndex;
+        }
+        siftUp(index, move(v));
     }
     bool empty() {
         return vs_.empty();
     }
-    void makeHeap(const vector<T> &vs) {
-        vs_ = vs;
-        for (int64_t i = vs.size() / 2;i >= 0;i--) {
+    //直接接管vs，不拷贝
+    void makeHeap(vector<T> &&vs) {
+        vs_ = move(vs);
+        makeHeap();
+    }
+private:
+    void makeHeap() {
+        if (vs_.size() < 2) {
+            return;
+        }
+        for (int64_t i = parent(vs_.size() - 1);i >= 0;i--) {
             heapify(i);
         }
     }
-private:
     void heapify(int64_t index) {
-        int64_t leftIndex = left(index);
-        int64_t rightIndex = right(index);
-        int64_t largestIndex = index;
-        if (leftIndex < int64_t(vs_.size()) && cmp_(getValue(index), getValue(leftIndex))) {
-            largestIndex = leftIndex;
+        int64_t size = vs_.size();
+        int64_t first = firstChild(index);
+        if (first >= size) {
+            return;
         }
-        if (rightIndex < int64_t(vs_.size()) && cmp_(getValue(largestIndex), getValue(rightIndex))) {
-            largestIndex = rightIndex;
+        //已经不比孩子小时不用把元素拿出来再放回去，有序数据建堆时大部分位置都是这样
+        int64_t largestIndex = largestChild(first, min(first + Arity, size));
+        if (!cmp_(getValue(index), getValue(largestIndex))) {
+            return;
         }
-        if (largestIndex != index) {
-            swap(vs_[index], vs_[largestIndex]);
-            heapify(largestIndex);
+        T v = move(vs_[index]);
+        while(true) {
+            vs_[index] = move(vs_[largestIndex]);
+            index = largestIndex;
+            first = firstChild(index);
+            if (first >= size) {
+                break;
+            }
+            largestIndex = largestChild(first, min(first + Arity, size));
+            if (!cmp_(getValueFunc_(v), getValue(largestIndex))) {
+                break;
+            }
         }
+        vs_[index] = move(v);
     }
     void insert(const T &v) {
         vs_.push_back(v);
-        int64_t index = vs_.size() - 1;
-        while(index > 0 && cmp_(getValue(parent(index)), getValue(index))) {
-            swap(vs_[parent(index)], vs_[index]);
+        siftUpAt(vs_.size() - 1);
+    }
+    void siftUpAt(int64_t index) {
+        if (index == 0 || !cmp_(getValue(parent(index)), getValue(index))) {
+            return;
+        }
+        T hole = move(vs_[index]);
+        siftUp(index, move(hole));
+    }
+    //index是空位，v从这里往上找位置
+    void siftUp(int64_t index, T &&v) {
+        while(index > 0 && cmp_(getValue(parent(index)), getValueFunc_(v))) {
+            vs_[index] = move(vs_[parent(index)]);
             index = parent(index);
         }
+        vs_[index] = move(v);
     }
-    int64_t left(int64_t index) {
-        return 2 * index + 1;
+    int64_t largestChild(int64_t first, int64_t last) {
+        int64_t largestIndex = first;
+        for (int64_t child = first + 1;child < last;child++) {
+            if (cmp_(getValue(largestIndex), getValue(child))) {
+                largestIndex = child;
+            }
+        }
+        return largestIndex;
     }
-    int64_t right(int64_t index) {
-        return 2 * index + 2;
+    int64_t firstChild(int64_t index) {
+        return Arity * index + 1;
     }
     int64_t parent(int64_t index) {
-        return (index - 1) / 2;
+        return (index - 1) / Arity;
     }
-    int64_t getValue(int64_t index) {
+    decltype(auto) getValue(int64_t index) {
         return getValueFunc_(vs_[index]);
     }
     CmpT cmp_;
     getValueFuncT getValueFunc_;
     vector<T> vs_;
+    vector<int64_t> prunedPositions_;
+};
+
+//堆里只存(key, 下标)，元素本身放在slab里，下标在元素出堆前不变
+//getValueFunc_只在push时调用一次，上浮下沉只比较和移动紧凑的key，pair<int64_t, string>这类元素不会每层都搬string
+//元素只在出堆时move一次，slab空出来的位置放进freeList_给后面的push复用
+//getValueFunc返回引用时node里存的是key的拷贝，std::tie这种返回引用tuple的不能用
+//push返回Handle，nodePositions_记录每个slab下标现在在堆里的位置，移动node时一起更新，update和erase都是O(log n)
+//slab位置每释放一次generation加一，已经出堆的handle不会误改复用这个位置的新元素
+template <typename T, typename getValueFuncT, typename CmpT = std::less<decay_t<decltype(declval<getValueFuncT>()(declval<T>()))>>, int Arity = 2>
+class KeyCachedRangePopHeap {
+    static_assert(Arity >= 2, "arity must be at least 2");
+    using KeyT = decay_t<decltype(declval<getValueFuncT>()(declval<T>()))>;
+    struct Node {
+        KeyT key;
+        uint32_t index;
+    };
+public:
+    struct Handle {
+        uint32_t index;
+        uint32_t generation;
+    };
+    KeyCachedRangePopHeap(const getValueFuncT& func) : cmp_(CmpT()), getValueFunc_(func) {
+    }
+    KeyCachedRangePopHeap(const getValueFuncT& func, int size) : cmp_(CmpT()), getValueFunc_(func) {
+        nodes_.reserve(size);
+        slab_.reserve(size);
+    }
+    Handle push(const T& v) {
+        uint32_t index;
+        if (freeList_.empty()) {
+            index = slab_.size();
+            slab_.push_back(v);
+            nodePositions_.resize(slab_.size());
+            if (generations_.size() < slab_.size()) {
+                generations_.push_back(0);
+            }
+        }else {
+            index = freeList_.back();
+            freeList_.pop_back();
+            slab_[index] = v;
+        }
+        nodes_.push_back({getValueFunc_(v), index});
+        nodePositions_[index] = nodes_.size() - 1;
+        siftUp(nodes_.size() - 1);
+        return {index, generations_[index]};
+    }
+    //换成新元素，key变大变小都行，handle已经失效时返回false
+    bool update(const Handle &handle, const T& v) {
+        if (!valid(handle)) {
+            return false;
+        }
+        int64_t position = nodePositions_[handle.index];
+        slab_[handle.index] = v;
+        KeyT old = move(nodes_[position].key);
+        nodes_[position].key = getValueFunc_(v);
+        if (cmp_(old, nodes_[position].key)) {
+            siftUp(position);
+        }else {
+            heapify(position);
+        }
+        return true;
+    }
+    //用最后一个node填上空位再上浮或者下沉，handle已经失效时返回false
+    bool erase(const Handle &handle) {
+        if (!valid(handle)) {
+            return false;
+        }
+        int64_t position = nodePositions_[handle.index];
+        release(handle.index);
+        Node last = move(nodes_.back());
+        nodes_.pop_back();
+        if (position < (int64_t)nodes_.size()) {
+            bool up = position > 0 && cmp_(nodes_[parent(position)].key, last.key);
+            place(position, move(last));
+            if (up) {
+                siftUp(position);
+            }else {
+                heapify(position);
+            }
+        }
+        shrinkIfEmpty();
+        return true;
+    }
+    bool valid(const Handle &handle) {
+        return handle.index < slab_.size() && generations_[handle.index] == handle.generation;
+    }
+    //和RangePopHeap::rangePop一样按代价选做法
+    vector<T> rangePop(const KeyT& key) {
+        vector<T> results;
+        if (empty() || cmp_(nodes_[0].key, key)) {
+            return results;
+        }
+        int64_t n = nodes_.size();
+        int64_t estimated = estimateRangePopCount(n, [&](int64_t i) {return !cmp_(nodes_[i].key, key);});
+        int64_t budget = rangePopPrunedBudget(n, Arity, KEY_CACHED_RANGE_POP_SCAN_COST);
+        if (estimated < 2 * budget && rangePopPruned(key, results, budget)) {
+            return results;
+        }
+        results.reserve(min(n, estimated));
+        rangePopLargeData(key, results);
+        return results;
+    }
+    //和RangePopHeap::rangePopPruned一样，只是填空位和heapify都只搬node
+    bool rangePopPruned(const KeyT& key, vector<T>& results, int64_t countLimit = INT64_MAX) {
+        int64_t n = nodes_.size();
+        if (n == 0 || cmp_(nodes_[0].key, key)) {
+            return true;
+        }
+        auto &positions = prunedPositions_;
+        positions.clear();
+        positions.push_back(0);
+        for (size_t i = 0;i < positions.size();i++) {
+            if ((int64_t)positions.size() > countLimit) {
+                return false;
+            }
+            int64_t first = firstChild(positions[i]);
+            int64_t last = min(first + Arity, n);
+            for (int64_t child = first;child < last;child++) {
+                if (!cmp_(nodes_[child].key, key)) {
+                    positions.push_back(child);
+                }
+            }
+        }
+        int64_t k = positions.size();
+        int64_t m = n - k;
+        for (auto position : positions) {
+            uint32_t index = nodes_[position].index;
+            results.emplace_back(move(slab_[index]));
+            release(index);
+        }
+        int64_t holeEnd = lower_bound(positions.begin(), positions.end(), m) - positions.begin();
+        int64_t tail = n - 1;
+        int64_t j = k - 1;
+        for (int64_t i = 0;i < holeEnd;i++) {
+            while(j >= holeEnd && positions[j] == tail) {
+                tail--;
+                j--;
+            }
+            place(positions[i], move(nodes_[tail--]));
+        }
+        nodes_.resize(m);
+        for (int64_t i = holeEnd - 1;i >= 0;i--) {
+            heapify(positions[i]);
+        }
+        shrinkIfEmpty();
+        return true;
+    }
+    //只搬node，要弹出的元素直接从slab move到results
+    void rangePopLargeData(const KeyT& key, vector<T>& results) {
+        size_t kept = 0;
+        for (size_t i = 0;i < nodes_.size();i++) {
+            Node &node = nodes_[i];
+            if (cmp_(node.key, key)) {
+                //没动位置的不用搬，也避免自己move给自己
+                if (kept != i) {
+                    place(kept, move(node));
+                }
+                kept++;
+                continue;
+            }
+            results.emplace_back(move(slab_[node.index]));
+            release(node.index);
+        }
+        nodes_.resize(kept);
+        makeHeap();
+    }
+    vector<T> rangePopLittleData(const KeyT& key, int64_t countLimit, bool &ok) {
+        ok = false;
+        vector<T> results;
+        results.reserve(min<int64_t>(countLimit, nodes_.size()));
+        while(!empty()) {
+            if (cmp_(nodes_[0].key, key)) {
+                ok = true;
+                break;
+            }
+            if (!countLimit--) {
+                break;
+            }
+            results.emplace_back(move(top()));
+            pop();
+        }
+        ok |= empty();
+        return results;
+    }
+    T& top() {
+        return slab_[nodes_[0].index];
+    }
+    void pop() {
+        release(nodes_[0].index);
+        Node last = move(nodes_.back());
+        nodes_.pop_back();
+        if (nodes_.empty()) {
+            shrinkIfEmpty();
+            return;
+        }
+        int64_t size = nodes_.size();
+        int64_t index = 0;
+        while(true) {
+            int64_t first = firstChild(index);
+            if (first >= size) {
+                break;
+            }
+            int64_t largestIndex = largestChild(first, min(first + Arity, size));
+            place(index, move(nodes_[largestIndex]));
+            index = largestIndex;
+        }
+        place(index, move(last));
+        siftUp(index);
+    }
+    bool empty() {
+        return nodes_.empty();
+    }
+private:
+    void makeHeap() {
+        if (nodes_.size() < 2) {
+            return;
+        }
+        for (int64_t i = parent(nodes_.size() - 1);i >= 0;i--) {
+            heapify(i);
+        }
+    }
+    void heapify(int64_t index) {
+        int64_t size = nodes_.size();
+        Node node = move(nodes_[index]);
+        while(true) {
+            int64_t first = firstChild(index);
+            if (first >= size) {
+                break;
+            }
+            int64_t largestIndex = largestChild(first, min(first + Arity, size));
+            if (!cmp_(node.key, nodes_[largestIndex].key)) {
+                break;
+            }
+            place(index, move(nodes_[largestIndex]));
+            index = largestIndex;
+        }
+        place(index, move(node));
+    }
+    void siftUp(int64_t index) {
+        Node node = move(nodes_[index]);
+        while(index > 0 && cmp_(nodes_[parent(index)].key, node.key)) {
+            place(index, move(nodes_[parent(index)]));
+            index = parent(index);
+        }
+        place(index, move(node));
+    }
+    int64_t largestChild(int64_t first, int64_t last) {
+        int64_t largestIndex = first;
+        for (int64_t child = first + 1;child < last;child++) {
+            if (cmp_(nodes_[largestIndex].key, nodes_[child].key)) {
+                largestIndex = child;
+            }
+        }
+        return largestIndex;
+    }
+    //node都是move进来的，string这类key不会每层复制一次
+    void place(int64_t position, Node &&node) {
+        nodePositions_[node.index] = position;
+        nodes_[position] = move(node);
+    }
+    void release(uint32_t index) {
+        freeList_.push_back(index);
+        generations_[index]++;
+    }
+    //空了就把slab一起清掉，出过堆的元素不会一直占着内存，generations_留着，旧handle还是失效的
+    void shrinkIfEmpty() {
+        if (nodes_.empty()) {
+            slab_.clear();
+            freeList_.clear();
+            nodePositions_.clear();
+        }
+    }
+    int64_t firstChild(int64_t index) {
+        return Arity * index + 1;
+    }
+    int64_t parent(int64_t index) {
+        return (index - 1) / Arity;
+    }
+    CmpT cmp_;
+    getValueFuncT getValueFunc_;
+    vector<Node> nodes_;
+    vector<T> slab_;
+    vector<uint32_t> freeList_;
+    vector<uint32_t> nodePositions_;
+    vector<uint32_t> generations_;
+    vector<int64_t> prunedPositions_;
+};
+
+//分层时间轮，key是毫秒时间戳，和RangePopHeap一样push/rangePop(key)，key只能往后走
+//TIMING_WHEEL_LEVELS层，每层2^TIMING_WHEEL_BITS个槽，第0层一个槽1ms，第L层一个槽2^(BITS * L)ms，4层共2^32ms，约49天
+//push按离current_的距离放进能放下的最低一层，O(1)
+//current_走到第L层一圈的开头时，把第L + 1层对应槽里的元素重新放一遍(cascade)，每个元素最多下放LEVELS - 1次，摊还O(1)
+//每层用位图记录哪些槽非空，rangePop直接跳到下一个非空槽的到期或者cascade时间，中间的空槽和空的cascade都跳过
+//每个槽是slab里的侵入式双向链表，push返回的Handle可以O(1)取消，generation防止取消已经复用的位置
+//时间已经不晚于current_的元素放在ready链表，下一次rangePop时弹出，超过4层范围的放在overflow链表，最高层转一圈时再放
+#define TIMING_WHEEL_BITS 8
+#define TIMING_WHEEL_LEVELS 4
+
+template <typename T, typename getValueFuncT>
+class TimingWheel {
+    static constexpr int64_t kSlots = 1 << TIMING_WHEEL_BITS;
+    static constexpr int64_t kMask = kSlots - 1;
+    static constexpr uint32_t kReadyList = TIMING_WHEEL_LEVELS * kSlots;
+    static constexpr uint32_t kOverflowList = kReadyList + 1;
+    static constexpr uint32_t kNil = UINT32_MAX;
+    struct Entry {
+        T value;
+        int64_t time;
+        uint32_t prev;
+        uint32_t next;
+        uint32_t slot;
+        uint32_t generation;
+    };
+public:
+    struct Handle {
+        uint32_t index;
+        uint32_t generation;
+    };
+    TimingWheel(const getValueFuncT& func, int64_t now) : getValueFunc_(func), current_(now), heads_(kOverflowList + 1, kNil) {
+        occupied_.fill(0);
+    }
+    TimingWheel(const getValueFuncT& func, int64_t now, int size) : TimingWheel(func, now) {
+        entries_.reserve(size);
+    }
+    Handle push(const T& v) {
+        uint32_t index;
+        if (freeList_.empty()) {
+            index = entries_.size();
+            entries_.push_back({v, 0, kNil, kNil, kNil, 0});
+        }else {
+            index = freeList_.back();
+            freeList_.pop_back();
+            entries_[index].value = v;
+        }
+        entries_[index].time = getValueFunc_(v);
+        place(index);
+        size_++;
+        return {index, entries_[index].generation};
+    }
+    //已经弹出或者取消过的handle返回false
+    bool cancel(const Handle &handle) {
+        if (handle.index >= entries_.size()) {
+            return false;
+        }
+        auto &entry = entries_[handle.index];
+        if (entry.generation != handle.generation || entry.slot == kNil) {
+            return false;
+        }
+        unlink(handle.index);
+        release(handle.index);
+        return true;
+    }
+    //弹出所有时间<= key的元素，按时间递增
+    vector<T> rangePop(int64_t key) {
+        vector<T> results;
+        //ready链表里是push时已经过期的，时间各不相同，先排好序，它们都早于任何一个槽
+        collect(heads_[kReadyList], results);
+        sort(results.begin(), results.end(), [&](const T &a, const T &b) {
+            return getValueFunc_(a) < getValueFunc_(b);
+        });
+        while(current_ < key) {
+            int64_t next = nextEvent();
+            if (next > key) {
+                current_ = key;
+                break;
+            }
+            current_ = next;
+            if ((next & kMask) == 0) {
+                cascade(next);
+                //cascade到ready链表的时间都正好是next，和第0层这个槽里的一样，要在后面的槽之前弹出
+                collect(heads_[kReadyList], results);
+            }
+            collect(heads_[next & kMask], results);
+        }
+        return results;
+    }
+    bool empty() {
+        return size_ == 0;
+    }
+    int64_t size() {
+        return size_;
+    }
+private:
+    void place(uint32_t index) {
+        int64_t time = entries_[index].time;
+        int64_t delta = time - current_;
+        if (delta <= 0) {
+            link(index, kReadyList);
+            return;
+        }
+        for (int level = 0;level < TIMING_WHEEL_LEVELS;level++) {
+            if (delta < (int64_t(1) << (TIMING_WHEEL_BITS * (level + 1)))) {
+                link(index, level * kSlots + ((time >> (TIMING_WHEEL_BITS * level)) & kMask));
+                return;
+            }
+        }
+        link(index, kOverflowList);
+    }
+    //now是第0层一圈的开头，依次把上面各层对应的槽重新放，某一层不是一圈的开头时更高层不用动
+    void cascade(int64_t now) {
+        for (int level = 1;level < TIMING_WHEEL_LEVELS;level++) {
+            int64_t slot = (now >> (TIMING_WHEEL_BITS * level)) & kMask;
+            replace(level * kSlots + slot);
+            if (slot != 0) {
+                return;
+            }
+        }
+        replace(kOverflowList);
+    }
+    void replace(uint32_t list) {
+        uint32_t index = heads_[list];
+        heads_[list] = kNil;
+        if (list < kReadyList) {
+            occupied_[list >> 6] &= ~(uint64_t(1) << (list & 63));
+        }
+        while(index != kNil) {
+            uint32_t next = entries_[index].next;
+            place(index);
+            index = next;
+        }
+    }
+    //把整条链表的元素move进results，head是链表头的引用
+    void collect(uint32_t &head, vector<T> &results) {
+        uint32_t index = head;
+        if (index == kNil) {
+            return;
+        }
+        uint32_t list = entries_[index].slot;
+        head = kNil;
+        if (list < kReadyList) {
+            occupied_[list >> 6] &= ~(uint64_t(1) << (list & 63));
+        }
+        while(index != kNil) {
+            uint32_t next = entries_[index].next;
+            results.emplace_back(move(entries_[index].value));
+            release(index);
+            index = next;
+        }
+    }
+    //下一个要处理的时间: 第0层非空槽的到期时间，或者上面某层非空槽要cascade的时间，没有返回LLONG_MAX
+    //第0层找到的时间在这一圈以内时，上面的层不会更早，不用再找
+    int64_t nextEvent() {
+        int64_t result = LLONG_MAX;
+        for (int level = 0;level < TIMING_WHEEL_LEVELS;level++) {
+            int shift = TIMING_WHEEL_BITS * level;
+            int64_t distance = nextOccupied(level, ((current_ >> shift) + 1) & kMask);
+            if (distance >= 0) {
+                result = min(result, ((current_ >> shift) + 1 + distance) << shift);
+            }
+            if (level == 0 && result < ((current_ | kMask) + 1)) {
+                return result;
+            }
+        }
+        if (heads_[kOverflowList] != kNil) {
+            int shift = TIMING_WHEEL_BITS * TIMING_WHEEL_LEVELS;
+            result = min(result, ((current_ >> shift) + 1) << shift);
+        }
+        return result;
+    }
+    //第level层从from开始循环找第一个非空槽，返回离from的距离，全空返回-1
+    int64_t nextOccupied(int level, int64_t from) {
+        const uint64_t *words = &occupied_[level * kSlots / 64];
+        for (int64_t distance = 0;distance < kSlots;) {
+            int64_t bit = (from + distance) & kMask;
+            uint64_t word = words[bit >> 6] >> (bit & 63);
+            if (word) {
+                return distance + __builtin_ctzll(word);
+            }
+            distance += 64 - (bit & 63);
+        }
+        return -1;
+    }
+    void link(uint32_t index, uint32_t list) {
+        auto &entry = entries_[index];
+        entry.slot = list;
+        entry.prev = kNil;
+        entry.next = heads_[list];
+        if (entry.next != kNil) {
+            entries_[entry.next].prev = index;
+        }
+        heads_[list] = index;
+        if (list < kReadyList) {
+            occupied_[list >> 6] |= uint64_t(1) << (list & 63);
+        }
+    }
+    void unlink(uint32_t index) {
+        auto &entry = entries_[index];
+        if (entry.prev != kNil) {
+            entries_[entry.prev].next = entry.next;
+        }else {
+            heads_[entry.slot] = entry.next;
+            if (entry.next == kNil && entry.slot < kReadyList) {
+                occupied_[entry.slot >> 6] &= ~(uint64_t(1) << (entry.slot & 63));
+            }
+        }
+        if (entry.next != kNil) {
+            entries_[entry.next].prev = entry.prev;
+        }
+    }
+    void release(uint32_t index) {
+        entries_[index].slot = kNil;
+        entries_[index].generation++;
+        freeList_.push_back(index);
+        size_--;
+    }
+    getValueFuncT getValueFunc_;
+    int64_t current_;
+    int64_t size_ = 0;
+    vector<Entry> entries_;
+    vector<uint32_t> freeList_;
+    vector<uint32_t> heads_;
+    array<uint64_t, TIMING_WHEEL_LEVELS * kSlots / 64> occupied_;
 };
 
 template <typename T, typename getValueFuncT, typename CmpT>
@@ -121,10 +816,10 @@ void checkHeap(T heap, const getValueFuncT& getValueFunc_) {
         return;
     }
     CmpT cmp;
-    int last = getValueFunc_(heap.top());
+    decay_t<decltype(getValueFunc_(heap.top()))> last = getValueFunc_(heap.top());
     while(!heap.empty()) {
         auto &v = heap.top();
-        auto realV = getValueFunc_(v);
+        decay_t<decltype(getValueFunc_(v))> realV = getValueFunc_(v);
         if (cmp(last, realV)) {
             cout << "wtf" << endl;
             break;
@@ -135,8 +830,223 @@ void checkHeap(T heap, const getValueFuncT& getValueFunc_) {
 }
 int allCount = 0;
 int nestCount = 0;
-int now = 0;
-using pairT = pair<int, string>;
+int64_t now = 0;
+using pairT = pair<int64_t, string>;
+
+//把堆弹空，按弹出顺序返回，顺便检查key不递减
+template <typename HeapT>
+vector<pairT> drainHeap(HeapT heap, const string &name) {
+    vector<pairT> result;
+    while(!heap.empty()) {
+        if (!result.empty() && heap.top().first < result.back().first) {
+            cout << name << " pop order failed" << endl;
+        }
+        result.push_back(heap.top());
+        heap.pop();
+    }
+    return result;
+}
+
+//随机数据检查rangePopPruned: 弹出的个数和内容，countLimit不够时返回false并且堆不变，之后的pop和push顺序都对
+template <template <typename, typename, typename, int> class HeapT, int Arity>
+void testRangePopPrunedRandom(const string &name) {
+    auto f = [](const pairT &v) {
+        return v.first;
+    };
+    for (int round = 0;round < 300;round++) {
+        HeapT<pairT, decltype(f), std::greater<int64_t>, Arity> heap(f);
+        multiset<pairT> ref;
+        int n = vector<int>{0, 1, 2, 3, 10, 100, 1000, 3000}[round % 8];
+        for (int i = 0;i < n;i++) {
+            pairT v{rand() % 1000, to_string(i)};
+            heap.push(v);
+            ref.insert(v);
+        }
+        //key从比最小的还小到比最大的还大都取到
+        int64_t key = rand() % 1002 - 1;
+        vector<pairT> expected;
+        for (auto iter = ref.begin();iter != ref.end() && iter->first <= key;) {
+            expected.push_back(*iter);
+            iter = ref.erase(iter);
+        }
+        int64_t countLimit = rand() % 2 ? INT64_MAX : rand() % (expected.size() + 2);
+        auto before = drainHeap(heap, name);
+        vector<pairT> results;
+        bool ok = heap.rangePopPruned(key, results, countLimit);
+        if (ok != ((int64_t)expected.size() <= countLimit)) {
+            cout << name << " rangePopPruned ok failed" << LOGV(Arity) << LOGV(n) << LOGV(key) << LOGV(countLimit) << endl;
+        }
+        if (!ok) {
+            if (!results.empty() || drainHeap(heap, name) != before) {
+                cout << name << " rangePopPruned changed heap on failure" << LOGV(Arity) << LOGV(n) << endl;
+            }
+            continue;
+        }
+        sort(results.begin(), results.end());
+        if (results != expected) {
+            cout << name << " rangePopPruned results failed" << LOGV(Arity) << LOGV(n) << LOGV(key) << endl;
+        }
+        for (int i = 0;i < 10;i++) {
+            pairT v{rand() % 1000, "new" + to_string(i)};
+            heap.push(v);
+            ref.insert(v);
+        }
+        auto after = drainHeap(heap, name);
+        if (multiset<pairT>(after.begin(), after.end()) != ref) {
+            cout << name << " rangePopPruned remaining failed" << LOGV(Arity) << LOGV(n) << LOGV(key) << endl;
+        }
+    }
+}
+
+//随机混合push, update(key变大变小), erase, rangePop和pop，和参考map比较
+//每一步都检查nodePositions_和nodes_对得上，活着的handle有效而且指向对的元素，死掉的handle无效
+template <int Arity>
+void testHandleRandom() {
+    auto f = [](const pairT &v) {
+        return v.first;
+    };
+    using HeapT = KeyCachedRangePopHeap<pairT, decltype(f), std::greater<int64_t>, Arity>;
+    HeapT heap(f);
+    map<int, pair<typename HeapT::Handle, pairT>> live;
+    vector<typename HeapT::Handle> dead;
+    int id = 0;
+    auto fail = [&](const string &what) {
+        cout << "KeyCachedRangePopHeap handle " << what << " failed" << LOGV(Arity) << LOGV(id) << endl;
+    };
+    auto randomLive = [&]() {
+        auto iter = live.lower_bound(rand() % id);
+        return iter == live.end() ? live.begin() : iter;
+    };
+    for (int step = 0;step < 20000;step++) {
+        int op = rand() % 20;
+        if (op < 8 || live.empty()) {
+            pairT v{rand() % 1000, to_string(id)};
+            live[id++] = {heap.push(v), v};
+        }else if (op < 12) {
+            auto iter = randomLive();
+            pairT v{rand() % 1000, iter->second.second.second};
+            if (!heap.update(iter->second.first, v)) {
+                fail("update");
+            }
+            iter->second.second = v;
+        }else if (op < 15) {
+            auto iter = randomLive();
+            if (!heap.erase(iter->second.first)) {
+                fail("erase");
+            }
+            dead.push_back(iter->second.first);
+            live.erase(iter);
+        }else if (op < 16) {
+            if (!dead.empty()) {
+                auto handle = dead[rand() % dead.size()];
+                if (heap.valid(handle) || heap.erase(handle) || heap.update(handle, {0, ""})) {
+                    fail("stale handle");
+                }
+            }
+        }else {
+            int64_t key = rand() % 1000;
+            vector<pairT> results;
+            if (op < 18) {
+                results = heap.rangePop(key);
+            }else {
+                while(!heap.empty() && heap.top().first <= key) {
+                    results.push_back(heap.top());
+                    heap.pop();
+                }
+            }
+            vector<pairT> expected;
+            for (auto iter = live.begin();iter != live.end();) {
+                if (iter->second.second.first <= key) {
+                    expected.push_back(iter->second.second);
+                    dead.push_back(iter->second.first);
+                    iter = live.erase(iter);
+                }else {
+                    iter++;
+                }
+            }
+            sort(results.begin(), results.end());
+            sort(expected.begin(), expected.end());
+            if (results != expected) {
+                fail("rangePop");
+            }
+        }
+        if (heap.nodes_.size() != live.size()) {
+            fail("size");
+        }
+        for (size_t i = 0;i < heap.nodes_.size();i++) {
+            if (heap.nodePositions_[heap.nodes_[i].index] != i) {
+                fail("nodePositions_");
+            }
+        }
+        int64_t minKey = INT64_MAX;
+        for (auto &kv : live) {
+            auto &handle = kv.second.first;
+            if (!heap.valid(handle) || heap.slab_[handle.index] != kv.second.second) {
+                fail("live handle");
+            }
+            minKey = min(minKey, kv.second.second.first);
+        }
+        if (!heap.empty() && heap.top().first != minKey) {
+            fail("top");
+        }
+    }
+    checkHeap<HeapT, decltype(f), std::greater<int64_t>>(heap, f);
+}
+
+//时间轮随机测试: 距离覆盖第0层到overflow(>= 2^32ms)，rangePop跳几毫秒到几十天，每次都和multiset比较
+void testTimingWheelRandom() {
+    auto f = [](const pairT &v) {
+        return v.first;
+    };
+    vector<int64_t> spans{10, 300, 70000, 20000000, 1LL << 26, 5000000000LL};
+    for (int round = 0;round < 10;round++) {
+        int64_t current = now + rand() % 1000000;
+        TimingWheel<pairT, decltype(f)> wheel(f, current);
+        multiset<pairT> ref;
+        vector<pair<TimingWheel<pairT, decltype(f)>::Handle, pairT>> handles;
+        for (int step = 0;step < 20000;step++) {
+            int op = rand() % 10;
+            int64_t span = spans[rand() % spans.size()];
+            if (op < 6) {
+                pairT v{current - 5 + (int64_t)((((uint64_t)rand() << 31) ^ rand()) % span), to_string(step)};
+                handles.push_back({wheel.push(v), v});
+                ref.insert(v);
+            }else if (op < 8 && !handles.empty()) {
+                auto &handle = handles[rand() % handles.size()];
+                auto iter = ref.find(handle.second);
+                if (wheel.cancel(handle.first) != (iter != ref.end())) {
+                    cout << "TimingWheel cancel failed" << endl;
+                }
+                if (iter != ref.end()) {
+                    ref.erase(iter);
+                }
+            }else {
+                int64_t key = current + rand() % (span + 1);
+                auto result = wheel.rangePop(key);
+                current = max(current, key);
+                vector<pairT> expected;
+                for (auto iter = ref.begin();iter != ref.end() && iter->first <= key;) {
+                    expected.push_back(*iter);
+                    iter = ref.erase(iter);
+                }
+                if (!is_sorted(result.begin(), result.end(), [](const pairT &a, const pairT &b) {return a.first < b.first;})) {
+                    cout << "TimingWheel rangePop order failed" << LOGV(key) << endl;
+                }
+                sort(result.begin(), result.end());
+                if (result != expected) {
+                    cout << "TimingWheel rangePop failed" << LOGV(key) << LOGV(result.size()) << LOGV(expected.size()) << endl;
+                }
+            }
+            if (wheel.size() != (int64_t)ref.size()) {
+                cout << "TimingWheel size failed" << endl;
+            }
+        }
+        auto result = wheel.rangePop(current + spans.back() + 1);
+        if (result.size() != ref.size() || !wheel.empty()) {
+            cout << "TimingWheel final rangePop failed" << endl;
+        }
+    }
+}
 
 void testAlgorithm() {
     cout << "test algorithm start" << endl;
@@ -155,6 +1065,15 @@ void testAlgorithm() {
         }
         checkHeap<decltype(heap), decltype(f), std::greater<int>>(heap, f);
     }
+    testRangePopPrunedRandom<RangePopHeap, 2>("RangePopHeap");
+    testRangePopPrunedRandom<RangePopHeap, 4>("RangePopHeap");
+    testRangePopPrunedRandom<RangePopHeap, 8>("RangePopHeap");
+    testRangePopPrunedRandom<KeyCachedRangePopHeap, 2>("KeyCachedRangePopHeap");
+    testRangePopPrunedRandom<KeyCachedRangePopHeap, 4>("KeyCachedRangePopHeap");
+    testRangePopPrunedRandom<KeyCachedRangePopHeap, 8>("KeyCachedRangePopHeap");
+    testHandleRandom<2>();
+    testHandleRandom<4>();
+    testTimingWheelRandom();
     cout << "test algorithm end" << endl;
 }
 
@@ -173,7 +1092,7 @@ void testIntOrderedPerformace() {
         }
     }
     {
-        priority_queue<int64_t, vector<int64_t>, std::greater<int>> q;
+        priority_queue<int64_t, vector<int64_t>, std::greater<int64_t>> q;
         Timer t("priority_queue");
         for (auto &v : vs) {
             q.push(v);
@@ -183,12 +1102,20 @@ void testIntOrderedPerformace() {
         auto f = [](const int64_t &v) {
             return v;
         };
-        RangePopHeap<int64_t, decltype(f), std::greater<int>> q(f, allCount);
+        RangePopHeap<int64_t, decltype(f), std::greater<int64_t>> q(f, allCount);
         Timer t("RangePopHeap");
         for (auto &v : vs) {
             q.push(v);
         }
     }
+    {
+        auto f = [](const int64_t &v) {
+            return v;
+        };
+        RangePopHeap<int64_t, decltype(f), std::greater<int64_t>> q(f, allCount);
+        Timer t("RangePopHeap pushBulk");
+        q.pushBulk(vs);
+    }
     cout << "test int64 ordered performance end" << endl;
 }
 
@@ -207,7 +1134,7 @@ void testIntReverseOrderedPerformace() {
         }
     }
     {
-        priority_queue<int64_t, vector<int64_t>, std::less<int>> q;
+        priority_queue<int64_t, vector<int64_t>, std::less<int64_t>> q;
         Timer t("priority_queue");
         for (auto &v : vs) {
             q.push(v);
@@ -217,12 +1144,20 @@ void testIntReverseOrderedPerformace() {
         auto f = [](const int64_t &v) {
             return v;
         };
-        RangePopHeap<int64_t, decltype(f), std::less<int>> q(f, allCount);
+        RangePopHeap<int64_t, decltype(f), std::less<int64_t>> q(f, allCount);
         Timer t("RangePopHeap");
         for (auto &v : vs) {
             q.push(v);
         }
     }
+    {
+        auto f = [](const int64_t &v) {
+            return v;
+        };
+        RangePopHeap<int64_t, decltype(f), std::less<int64_t>> q(f, allCount);
+        Timer t("RangePopHeap pushBulk");
+        q.pushBulk(vs);
+    }
     cout << "test int64 reverse ordered performance end" << endl;
 }
 
@@ -240,7 +1175,7 @@ void testIntRandomPerformace() {
         }
     }
     {
-        priority_queue<int64_t, vector<int64_t>, std::greater<int>> q;
+        priority_queue<int64_t, vector<int64_t>, std::greater<int64_t>> q;
         Timer t("priority_queue");
         for (auto &v : vs) {
             q.push(v);
@@ -250,12 +1185,20 @@ void testIntRandomPerformace() {
         auto f = [](const int64_t &v) {
             return v;
         };
-        RangePopHeap<int64_t, decltype(f), std::greater<int>> q(f, allCount);
+        RangePopHeap<int64_t, decltype(f), std::greater<int64_t>> q(f, allCount);
         Timer t("RangePopHeap");
         for (auto &v : vs) {
             q.push(v);
         }
     }
+    {
+        auto f = [](const int64_t &v) {
+            return v;
+        };
+        RangePopHeap<int64_t, decltype(f), std::greater<int64_t>> q(f, allCount);
+        Timer t("RangePopHeap pushBulk");
+        q.pushBulk(vs);
+    }
     cout << "test int64 random performance end" << endl;
 }
 
@@ -276,7 +1219,7 @@ void testTimePerformance() {
         }
     }
     {
-        priority_queue<int64_t, vector<int64_t>, std::greater<int>> q;
+        priority_queue<int64_t, vector<int64_t>, std::greater<int64_t>> q;
         Timer t("priority_queue");
         for (auto &v : vs) {
             q.push(v);
@@ -286,12 +1229,20 @@ void testTimePerformance() {
         auto f = [](const int64_t &v) {
             return v;
         };
-        RangePopHeap<int64_t, decltype(f), std::greater<int>> q(f, allCount);
+        RangePopHeap<int64_t, decltype(f), std::greater<int64_t>> q(f, allCount);
         Timer t("RangePopHeap");
         for (auto &v : vs) {
             q.push(v);
         }
     }
+    {
+        auto f = [](const int64_t &v) {
+            return v;
+        };
+        RangePopHeap<int64_t, decltype(f), std::greater<int64_t>> q(f, allCount);
+        Timer t("RangePopHeap pushBulk");
+        q.pushBulk(vs);
+    }
     cout << "test int64 performance end" << endl;
 }
 
@@ -329,6 +1280,33 @@ void testTimePairPerformance() {
             q.push(v);
         }
     }
+    {
+        auto f = [](const pairT &v) {
+            return v.first;
+        };
+        RangePopHeap<pairT, decltype(f), std::greater<int64_t>> q(f, allCount);
+        Timer t("RangePopHeap pushBulk");
+        q.pushBulk(vs);
+    }
+    {
+        auto f = [](const pairT &v) {
+            return v.first;
+        };
+        RangePopHeap<pairT, decltype(f), std::greater<int64_t>> q(f, allCount);
+        auto copy = vs;
+        Timer t("RangePopHeap makeHeap");
+        q.makeHeap(move(copy));
+    }
+    {
+        auto f = [](const pairT &v) {
+            return v.first;
+        };
+        KeyCachedRangePopHeap<pairT, decltype(f), std::greater<int64_t>> q(f, allCount);
+        Timer t("KeyCachedRangePopHeap");
+        for (auto &v : vs) {
+            q.push(v);
+        }
+    }
     cout << "test pairT performance end" << endl;
 }
 
@@ -343,7 +1321,7 @@ void testTimePairRangePopPerformance(int keyPercent = 2) {
         }
     }
 
-    int key = vs[vs.size() / keyPercent].first;
+    int64_t key = vs[(vs.size() - 1) / keyPercent].first;
     {
         map<int64_t, set<string>> m;
         for (auto &v : vs) {
@@ -366,35 +1344,523 @@ void testTimePairRangePopPerformance(int keyPercent = 2) {
         auto f = [](const pairT &v) {
             return v.first;
         };
-        RangePopHeap<pairT, decltype(f), std::greater<int>> q(f, allCount);
+        RangePopHeap<pairT, decltype(f), std::greater<int64_t>> q(f, allCount);
         for (auto &v : vs) {
             q.push(v);
         }
         auto q1 = q;
         auto q2 = q;
+        auto q3 = q;
         {
             Timer t("rangePopLargeData");
             vector<pairT> vs;
             vs.reserve(allCount * nestCount);
             q.rangePopLargeData(key, vs);
         }
-        checkHeap<decltype(q), decltype(f), std::greater<int>>(q, f);
+        checkHeap<decltype(q), decltype(f), std::greater<int64_t>>(q, f);
         {
             Timer t("rangePopLittleData");
             int64_t countLimit = INT_MAX;
             bool ok = false;
             auto result = q1.rangePopLittleData(key, countLimit, ok);
         }
-        checkHeap<decltype(q), decltype(f), std::greater<int>>(q1, f);
+        checkHeap<decltype(q), decltype(f), std::greater<int64_t>>(q1, f);
         {
             Timer t("rangePop");
             auto result = q2.rangePop(key);
         }
-        checkHeap<decltype(q), decltype(f), std::greater<int>>(q2, f);
+        checkHeap<decltype(q), decltype(f), std::greater<int64_t>>(q2, f);
+        {
+            Timer t("rangePopPruned");
+            vector<pairT> result;
+            q3.rangePopPruned(key, result);
+        }
+        checkHeap<decltype(q), decltype(f), std::greater<int64_t>>(q3, f);
+    }
+    {
+        auto f = [](const pairT &v) {
+            return v.first;
+        };
+        KeyCachedRangePopHeap<pairT, decltype(f), std::greater<int64_t>> q(f, allCount);
+        for (auto &v : vs) {
+            q.push(v);
+        }
+        auto q1 = q;
+        auto q2 = q;
+        auto q3 = q;
+        {
+            Timer t("key cached rangePopLargeData");
+            vector<pairT> vs;
+            vs.reserve(allCount * nestCount);
+            q.rangePopLargeData(key, vs);
+        }
+        checkHeap<decltype(q), decltype(f), std::greater<int64_t>>(q, f);
+        {
+            Timer t("key cached rangePopLittleData");
+            int64_t countLimit = INT_MAX;
+            bool ok = false;
+            auto result = q1.rangePopLittleData(key, countLimit, ok);
+        }
+        checkHeap<decltype(q), decltype(f), std::greater<int64_t>>(q1, f);
+        {
+            Timer t("key cached rangePop");
+            auto result = q2.rangePop(key);
+        }
+        checkHeap<decltype(q), decltype(f), std::greater<int64_t>>(q2, f);
+        {
+            Timer t("key cached rangePopPruned");
+            vector<pairT> result;
+            q3.rangePopPruned(key, result);
+        }
+        checkHeap<decltype(q), decltype(f), std::greater<int64_t>>(q3, f);
     }
     cout << "test pairT rangePop performance end" << endl;
 }
 
+//任意key类型的堆: 两种RangePopHeap和priority_queue比较push和全部pop的耗时，再检查rangePop弹出的个数和堆序
+template <typename T, typename getValueFuncT, typename CmpT>
+void testGenericKey(const string &name, const vector<T> &vs, const getValueFuncT &f,
+    const decay_t<decltype(declval<getValueFuncT>()(declval<T>()))> &key) {
+    cout << "test " << name << " key performance start" << endl;
+    CmpT cmp;
+    int64_t expected = 0;
+    for (auto &v : vs) {
+        expected += !cmp(f(v), key);
+    }
+    auto check = [&](auto q, const string &heapName) {
+        auto q1 = q;
+        {
+            Timer t(heapName + " pop");
+            while(!q1.empty()) {
+                q1.pop();
+            }
+        }
+        int64_t count = 0;
+        {
+            Timer t(heapName + " rangePop");
+            count = q.rangePop(key).size();
+        }
+        if (count != expected || (!q.empty() && !cmp(f(q.top()), key))) {
+            cout << heapName << " rangePop failed" << endl;
+        }
+        checkHeap<decltype(q), getValueFuncT, CmpT>(q, f);
+    };
+    {
+        auto pqCmp = [&](const T &a, const T &b) {
+            return cmp(f(a), f(b));
+        };
+        priority_queue<T, vector<T>, decltype(pqCmp)> q(pqCmp);
+        {
+            Timer t("priority_queue push");
+            for (auto &v : vs) {
+                q.push(v);
+            }
+        }
+        Timer t("priority_queue pop");
+        while(!q.empty()) {
+            q.pop();
+        }
+    }
+    {
+        RangePopHeap<T, getValueFuncT, CmpT, 4> q(f, vs.size());
+        {
+            Timer t("RangePopHeap push");
+            for (auto &v : vs) {
+                q.push(v);
+            }
+        }
+        check(q, "RangePopHeap");
+    }
+    {
+        KeyCachedRangePopHeap<T, getValueFuncT, CmpT, 4> q(f, vs.size());
+        {
+            Timer t("KeyCachedRangePopHeap push");
+            for (auto &v : vs) {
+                q.push(v);
+            }
+        }
+        check(q, "KeyCachedRangePopHeap");
+    }
+    cout << "test " << name << " key performance end" << endl;
+}
+
+//key是补零的时间字符串，getValueFunc返回引用
+void testStringKeyPerformance() {
+    using T = pair<string, int>;
+    vector<T> vs;
+    char buf[32];
+    for (int i = 0;i < allCount;i++) {
+        snprintf(buf, sizeof(buf), "%020ld", (long)(now + rand() % 1000000));
+        vs.push_back({buf, i});
+    }
+    auto f = [](const T &v) -> const string& {
+        return v.first;
+    };
+    string key = vs[rand() % vs.size()].first;
+    testGenericKey<T, decltype(f), std::greater<string>>("string", vs, f, key);
+}
+
+//(deadline, priority)组合key，deadline相同时priority小的先出
+struct DeadlineTask {
+    int64_t deadline;
+    int priority;
+    string name;
+};
+void testTupleKeyPerformance() {
+    vector<DeadlineTask> vs;
+    for (int i = 0;i < allCount;i++) {
+        vs.push_back({now + rand() % 100000, rand() % 8, to_string(i)});
+    }
+    auto f = [](const DeadlineTask &v) {
+        return make_tuple(v.deadline, v.priority);
+    };
+    auto key = f(vs[rand() % vs.size()]);
+    testGenericKey<DeadlineTask, decltype(f), std::greater<tuple<int64_t, int>>>("tuple", vs, f, key);
+}
+
+//push, pop和rangePop分别计时，rangePop分别弹出1%和50%的数据
+template <int Arity>
+void testArity(const vector<int64_t> &vs, const vector<int64_t> &keys) {
+    auto f = [](const int64_t &v) {
+        return v;
+    };
+    using HeapT = RangePopHeap<int64_t, decltype(f), std::greater<int64_t>, Arity>;
+    string name = "RangePopHeap arity " + to_string(Arity);
+    HeapT q(f, allCount);
+    {
+        Timer t(name + " push");
+        for (auto &v : vs) {
+            q.push(v);
+        }
+    }
+    checkHeap<HeapT, decltype(f), std::greater<int64_t>>(q, f);
+    for (auto key : keys) {
+        auto q1 = q;
+        {
+            Timer t(name + " rangePop " + to_string(key));
+            auto result = q1.rangePop(key);
+        }
+        checkHeap<HeapT, decltype(f), std::greater<int64_t>>(q1, f);
+    }
+    {
+        Timer t(name + " pop");
+        while(!q.empty()) {
+            q.pop();
+        }
+    }
+}
+
+void testArityPerformance() {
+    cout << "test arity performance start" << endl;
+    vector<int64_t> vs;
+    for (int i = 0;i < allCount;i++) {
+        vs.push_back(rand() % INT_MAX);
+    }
+    auto sorted = vs;
+    sort(sorted.begin(), sorted.end());
+    vector<int64_t> keys{sorted[sorted.size() / 100], sorted[sorted.size() / 2]};
+    {
+        priority_queue<int64_t, vector<int64_t>, std::greater<int64_t>> q;
+        {
+            Timer t("priority_queue push");
+            for (auto &v : vs) {
+                q.push(v);
+            }
+        }
+        Timer t("priority_queue pop");
+        while(!q.empty()) {
+            q.pop();
+        }
+    }
+    testArity<2>(vs, keys);
+    testArity<4>(vs, keys);
+    testArity<8>(vs, keys);
+    cout << "test arity performance end" << endl;
+}
+
+//到期循环: now开始每次往后走step毫秒，弹出所有到期的元素，一直到全部弹完
+//时间轮另外测一遍每10个取消一个
+void testTimingWheelPerformance(int64_t step = 10) {
+    cout << "test timing wheel performance start" << LOGV(step) << endl;
+    vector<pairT> vs;
+    for (int i = 0;i < allCount / nestCount;i++) {
+        int64_t v = now + i;
+        for (int j = 0;j < nestCount;j++) {
+            string s = to_string(i * nestCount + j);
+            vs.push_back({v - j, s});
+        }
+    }
+    int64_t end = now + allCount / nestCount + step;
+    auto f = [](const pairT &v) {
+        return v.first;
+    };
+    auto check = [&](int64_t count, const string &name) {
+        if (count != (int64_t)vs.size()) {
+            cout << name << " expire failed" << LOGV(count) << endl;
+        }
+    };
+    {
+        map<int64_t, set<string>> m;
+        Timer t("map");
+        for (auto &v : vs) {
+            m[v.first].insert(v.second);
+        }
+        int64_t count = 0;
+        for (int64_t key = now;key < end;key += step) {
+            for (auto iter = m.begin(); iter != m.end() && iter->first <= key;) {
+                count += iter->second.size();
+                iter = m.erase(iter);
+            }
+        }
+        check(count, "map");
+    }
+    {
+        priority_queue<pairT, vector<pairT>, std::greater<pairT>> q;
+        Timer t("priority_queue");
+        for (auto &v : vs) {
+            q.push(v);
+        }
+        int64_t count = 0;
+        for (int64_t key = now;key < end;key += step) {
+            while(!q.empty() && q.top().first <= key) {
+                q.pop();
+                count++;
+            }
+        }
+        check(count, "priority_queue");
+    }
+    {
+        RangePopHeap<pairT, decltype(f), std::greater<int64_t>> q(f, allCount);
+        Timer t("RangePopHeap");
+        for (auto &v : vs) {
+            q.push(v);
+        }
+        int64_t count = 0;
+        for (int64_t key = now;key < end;key += step) {
+            count += q.rangePop(key).size();
+        }
+        check(count, "RangePopHeap");
+    }
+    {
+        KeyCachedRangePopHeap<pairT, decltype(f), std::greater<int64_t>> q(f, allCount);
+        Timer t("KeyCachedRangePopHeap");
+        for (auto &v : vs) {
+            q.push(v);
+        }
+        int64_t count = 0;
+        for (int64_t key = now;key < end;key += step) {
+            count += q.rangePop(key).size();
+        }
+        check(count, "KeyCachedRangePopHeap");
+    }
+    {
+        TimingWheel<pairT, decltype(f)> q(f, now, allCount);
+        Timer t("TimingWheel");
+        for (auto &v : vs) {
+            q.push(v);
+        }
+        int64_t count = 0;
+        for (int64_t key = now;key < end;key += step) {
+            auto result = q.rangePop(key);
+            for (auto &v : result) {
+                if (v.first > key) {
+                    cout << "TimingWheel rangePop failed" << LOGV(v.first) << LOGV(key) << endl;
+                }
+            }
+            count += result.size();
+        }
+        check(count, "TimingWheel");
+    }
+    {
+        //不计时，每一步和multiset比较，到期的必须全部弹出，晚弹也算错
+        TimingWheel<pairT, decltype(f)> q(f, now, allCount);
+        multiset<pairT> ref;
+        for (auto &v : vs) {
+            q.push(v);
+            ref.insert(v);
+        }
+        for (int64_t key = now;key < end;key += step) {
+            auto result = q.rangePop(key);
+            vector<pairT> expected;
+            for (auto iter = ref.begin();iter != ref.end() && iter->first <= key;) {
+                expected.push_back(*iter);
+                iter = ref.erase(iter);
+            }
+            sort(result.begin(), result.end());
+            if (result != expected) {
+                cout << "TimingWheel tick failed" << LOGV(key) << LOGV(result.size()) << LOGV(expected.size()) << endl;
+                break;
+            }
+        }
+    }
+    {
+        TimingWheel<pairT, decltype(f)> q(f, now, allCount);
+        vector<TimingWheel<pairT, decltype(f)>::Handle> handles;
+        handles.reserve(vs.size());
+        Timer t("TimingWheel cancel");
+        for (auto &v : vs) {
+            handles.push_back(q.push(v));
+        }
+        int64_t cancelled = 0;
+        for (size_t i = 0;i < handles.size();i += 10) {
+            cancelled += q.cancel(handles[i]);
+        }
+        //再取消一次应该失败
+        if (q.cancel(handles[0])) {
+            cout << "TimingWheel cancel twice" << endl;
+        }
+        int64_t count = 0;
+        for (int64_t key = now;key < end;key += step) {
+            count += q.rangePop(key).size();
+        }
+        check(count + cancelled, "TimingWheel cancel");
+        if (!q.empty()) {
+            cout << "TimingWheel not empty" << LOGV(q.size()) << endl;
+        }
+    }
+    cout << "test timing wheel performance end" << endl;
+}
+
+//定时器重排: 30%的定时器在到期前50ms被改到更晚的时间
+//没有handle时只能再push一份带新版本号的，弹出时丢掉旧版本，有handle时直接update
+struct ScheduledEvent {
+    int64_t time;
+    int id;
+    int version;
+    string name;
+};
+void testReschedulePerformance(int64_t step = 10) {
+    cout << "test reschedule performance start" << endl;
+    vector<ScheduledEvent> vs;
+    for (int i = 0;i < allCount / nestCount;i++) {
+        int64_t v = now + i;
+        for (int j = 0;j < nestCount;j++) {
+            int id = vs.size();
+            vs.push_back({v - j, id, 0, to_string(id)});
+        }
+    }
+    //(发出时间, 新的事件)，按发出时间排序
+    vector<pair<int64_t, ScheduledEvent>> reschedules;
+    vector<int64_t> finalTimes;
+    for (auto &v : vs) {
+        finalTimes.push_back(v.time);
+        if (rand() % 10 < 3) {
+            auto e = v;
+            e.time += 200 + rand() % 1000;
+            e.version = 1;
+            finalTimes.back() = e.time;
+            reschedules.push_back({v.time - 50, e});
+        }
+    }
+    sort(reschedules.begin(), reschedules.end(), [](const pair<int64_t, ScheduledEvent> &a, const pair<int64_t, ScheduledEvent> &b) {
+        return a.first < b.first;
+    });
+    int64_t end = now + allCount / nestCount + 1300;
+    auto f = [](const ScheduledEvent &v) {
+        return v.time;
+    };
+    auto check = [&](const vector<ScheduledEvent> &fired, int64_t &count, const string &name) {
+        for (auto &e : fired) {
+            if (e.time != finalTimes[e.id]) {
+                cout << name << " fired stale event" << LOGV(e.id) << endl;
+            }
+        }
+        count += fired.size();
+    };
+    auto lazy = [&](auto q, const string &name) {
+        vector<int> versions(vs.size(), 0);
+        int64_t count = 0;
+        int64_t pushed = vs.size();
+        Timer t(name + " lazy");
+        for (auto &v : vs) {
+            q.push(v);
+        }
+        size_t r = 0;
+        for (int64_t key = now;key < end;key += step) {
+            for (;r < reschedules.size() && reschedules[r].first <= key;r++) {
+                versions[reschedules[r].second.id] = reschedules[r].second.version;
+                q.push(reschedules[r].second);
+                pushed++;
+            }
+            auto result = q.rangePop(key);
+            result.erase(remove_if(result.begin(), result.end(), [&](const ScheduledEvent &e) {
+                return e.version != versions[e.id];
+            }), result.end());
+            check(result, count, name);
+        }
+        if (count != (int64_t)vs.size()) {
+            cout << name << " lazy failed" << LOGV(count) << endl;
+        }
+        cout << name << " lazy" << LOGV(pushed) << endl;
+    };
+    lazy(RangePopHeap<ScheduledEvent, decltype(f), std::greater<int64_t>>(f, allCount), "RangePopHeap");
+    lazy(KeyCachedRangePopHeap<ScheduledEvent, decltype(f), std::greater<int64_t>>(f, allCount), "KeyCachedRangePopHeap");
+    {
+        KeyCachedRangePopHeap<ScheduledEvent, decltype(f), std::greater<int64_t>> q(f, allCount);
+        vector<decltype(q)::Handle> handles;
+        handles.reserve(vs.size());
+        int64_t count = 0;
+        Timer t("KeyCachedRangePopHeap update");
+        for (auto &v : vs) {
+            handles.push_back(q.push(v));
+        }
+        size_t r = 0;
+        for (int64_t key = now;key < end;key += step) {
+            for (;r < reschedules.size() && reschedules[r].first <= key;r++) {
+                if (!q.update(handles[reschedules[r].second.id], reschedules[r].second)) {
+                    cout << "update failed" << LOGV(reschedules[r].second.id) << endl;
+                }
+            }
+            check(q.rangePop(key), count, "KeyCachedRangePopHeap update");
+        }
+        if (count != (int64_t)vs.size() || q.erase(handles[0])) {
+            cout << "KeyCachedRangePopHeap update failed" << LOGV(count) << endl;
+        }
+    }
+    cout << "test reschedule performance end" << endl;
+}
+
+//只能move的元素: makeHeap和右值pushBulk接管数组，rangePop各个路径都只move
+void testMoveOnly() {
+    cout << "test move only start" << endl;
+    using T = unique_ptr<int64_t>;
+    auto f = [](const T &v) {
+        return *v;
+    };
+    vector<T> vs;
+    vector<int64_t> values;
+    for (int i = 0;i < 10000;i++) {
+        values.push_back(rand() % 1000);
+        vs.emplace_back(new int64_t(values.back()));
+    }
+    RangePopHeap<T, decltype(f), std::greater<int64_t>, 4> q(f);
+    q.makeHeap(vector<T>(make_move_iterator(vs.begin()), make_move_iterator(vs.begin() + vs.size() / 2)));
+    q.pushBulk(vector<T>(make_move_iterator(vs.begin() + vs.size() / 2), make_move_iterator(vs.end())));
+    sort(values.begin(), values.end());
+    int64_t popped = 0;
+    vector<int64_t> keys{values[values.size() / 100], values[values.size() / 4], values[values.size() / 2], values.back()};
+    for (size_t i = 0;i < keys.size();i++) {
+        int64_t key = keys[i];
+        vector<T> result;
+        if (i == 0) {
+            result = q.rangePop(key);
+        }else if (i == 1) {
+            q.rangePopPruned(key, result);
+        }else if (i == 2) {
+            q.rangePopLargeData(key, result);
+        }else {
+            bool ok = false;
+            result = q.rangePopLittleData(key, INT_MAX, ok);
+        }
+        popped += result.size();
+        int64_t expected = upper_bound(values.begin(), values.end(), key) - values.begin();
+        if (popped != expected || (!q.empty() && *q.top() <= key)) {
+            cout << "move only rangePop failed" << LOGV(key) << LOGV(popped) << LOGV(expected) << endl;
+        }
+    }
+    cout << "test move only end" << endl;
+}
+
 int main() {
     srand(time(0));
 
@@ -402,14 +1868,25 @@ int main() {
     nestCount = 10;
     now = TNOWMS();
     testAlgorithm();
+    testMoveOnly();
     testIntOrderedPerformace();
     testIntReverseOrderedPerformace();
     testIntRandomPerformace();
     testTimePerformance();
     testTimePairPerformance();
     testTimePairRangePopPerformance();
+    testArityPerformance();
+    testStringKeyPerformance();
+    testTupleKeyPerformance();
+    testTimingWheelPerformance();
+    testTimingWheelPerformance(1000);
+    testReschedulePerformance();
     for (int i = 1;i < 30;i++) {
         testTimePairRangePopPerformance(i);
     }
+    //一直到只弹出1%，RangePopHeap的两种做法在2%附近交叉
+    for (int i : {35, 50, 70, 100}) {
+        testTimePairRangePopPerformance(i);
+    }
     return 0;
 }